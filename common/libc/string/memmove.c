@@ -48,7 +48,8 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d;
+	const char *s;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,33 +85,45 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Copy by words where we can, working down from the end. Look
+	 * in memcpy.c for more information.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (char *)dst + len;
+	s = (const char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
+	if (len >= 2 * sizeof(long) &&
+	    (uintptr_t)d % sizeof(long) == (uintptr_t)s % sizeof(long)) {
+		long *ld;
+		const long *ls;
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*--d = *--s;
+			len--;
+		}
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		ld = (long *)d;
+		ls = (const long *)s;
+		while (len >= 4 * sizeof(long)) {
+			ld -= 4;
+			ls -= 4;
+			ld[3] = ls[3];
+			ld[2] = ls[2];
+			ld[1] = ls[1];
+			ld[0] = ls[0];
+			len -= 4 * sizeof(long);
 		}
+		while (len >= sizeof(long)) {
+			*--ld = *--ls;
+			len -= sizeof(long);
+		}
+		d = (char *)ld;
+		s = (const char *)ls;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
@@ -36,9 +36,15 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+/* Word-at-a-time helpers; see strlen.c. */
+#define ONES		((unsigned long)-1 / 0xff)
+#define HIGHS		(ONES * 0x80)
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+
 /*
  * C standard string function: find leftmost instance of a character
  * in a string.
@@ -48,8 +54,35 @@ strchr(const char *s, int ch_arg)
 {
 	/* avoid sign-extension problems */
 	const char ch = ch_arg;
+	const unsigned long *ls;
+	unsigned long chs, w;
+
+	/* scan bytes until we're word-aligned */
+	while ((uintptr_t)s % sizeof(long) != 0) {
+		if (*s == ch) {
+			return (char *)s;
+		}
+		if (*s == 0) {
+			return NULL;
+		}
+		s++;
+	}
+
+	/*
+	 * Then skip whole words with neither the terminator nor CH in
+	 * them. (XORing with CH in every byte turns bytes equal to CH
+	 * into zeros.)
+	 */
+	chs = ONES * (unsigned char)ch;
+	for (ls = (const unsigned long *)s; ; ls++) {
+		w = *ls;
+		if (HASZERO(w) || HASZERO(w ^ chs)) {
+			break;
+		}
+	}
 
 	/* scan from left to right */
+	s = (const char *)ls;
 	while (*s) {
 		/* if we hit it, return it */
 		if (*s == ch) {
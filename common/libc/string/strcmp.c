@@ -36,9 +36,15 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+/* Word-at-a-time helpers; see strlen.c. */
+#define ONES		((unsigned long)-1 / 0xff)
+#define HIGHS		(ONES * 0x80)
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+
 /*
  * Standard C string function: compare two strings and return their
  * sort order.
@@ -49,6 +55,36 @@ strcmp(const char *a, const char *b)
 {
 	size_t i;
 
+	/*
+	 * If both strings have the same alignment within a word, get
+	 * past the leading bytes and then compare a word at a time
+	 * while the words match and don't contain the end of A (and
+	 * so, since they match, of B). This never reads a word past
+	 * the one holding either terminator, so it can't fault. The
+	 * byte loop below then sorts out the word where they stopped.
+	 */
+	if ((uintptr_t)a % sizeof(long) == (uintptr_t)b % sizeof(long)) {
+		const unsigned long *la, *lb;
+
+		while ((uintptr_t)a % sizeof(long) != 0) {
+			if (*a == 0 || *a != *b) {
+				break;
+			}
+			a++;
+			b++;
+		}
+		if ((uintptr_t)a % sizeof(long) == 0) {
+			la = (const unsigned long *)a;
+			lb = (const unsigned long *)b;
+			while (*la == *lb && !HASZERO(*la)) {
+				la++;
+				lb++;
+			}
+			a = (const char *)la;
+			b = (const char *)lb;
+		}
+	}
+
 	/*
 	 * Walk down both strings until either they're different
 	 * or we hit the end of A.
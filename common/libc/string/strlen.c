@@ -36,9 +36,20 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+/*
+ * Word-at-a-time helpers. ONES has 0x01 in every byte of a word and
+ * HIGHS 0x80. HASZERO(w) is nonzero if and only if some byte of W
+ * is 0: subtracting 1 from a zero byte borrows into its high bit,
+ * and the ~w excludes bytes whose high bit was already set.
+ */
+#define ONES		((unsigned long)-1 / 0xff)
+#define HIGHS		(ONES * 0x80)
+#define HASZERO(w)	(((w) - ONES) & ~(w) & HIGHS)
+
 /*
  * C standard string function: get length of a string
  */
@@ -46,10 +57,26 @@
 size_t
 strlen(const char *str)
 {
-	size_t ret = 0;
+	const char *s = str;
+	const unsigned long *ls;
 
-	while (str[ret]) {
-		ret++;
+	/*
+	 * Check bytes until we're word-aligned, then whole words until
+	 * one has a 0 in it. Reading the whole of the word holding the
+	 * terminator can't fault even if the string ends early in it,
+	 * because a word never crosses a page boundary.
+	 */
+	while ((uintptr_t)s % sizeof(long) != 0) {
+		if (*s == 0) {
+			return s - str;
+		}
+		s++;
+	}
+	for (ls = (const unsigned long *)s; !HASZERO(*ls); ls++) {
+		/* nothing */
+	}
+	for (s = (const char *)ls; *s != 0; s++) {
+		/* nothing */
 	}
-	return ret;
+	return s - str;
 }
@@ -39,6 +39,8 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <kern/wait.h>
+#include "opt-A3.h"
 
 
 /* in exception.S */
@@ -108,13 +110,17 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		break;
 	}
 
+	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
+		code, sig, trapcodenames[code], epc, vaddr);
+#if OPT_A3
+	/* Kill the process, as if by the signal. */
+	proc_exit(_MKWAIT_SIG(sig));
+#else
 	/*
 	 * You will probably want to change this.
 	 */
-
-	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
-		code, sig, trapcodenames[code], epc, vaddr);
 	panic("I don't know how to handle this\n");
+#endif
 }
 
 /*
@@ -151,10 +157,14 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_user;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		/* for hardclock's accounting */
+		old_user = curthread->t_intr_user;
+		curthread->t_intr_user = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -194,6 +204,7 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+		curthread->t_intr_user = old_user;
 		goto done2;
 	}
 
@@ -31,6 +31,8 @@
 #include <kern/errno.h>
 #include <kern/syscall.h>
 #include <lib.h>
+#include <endian.h>
+#include <copyinout.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
@@ -83,6 +85,16 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#ifdef OPT_A2
+	off_t retval64;
+	bool is64;
+	uint64_t pos64;
+	off_t pos;
+	int whence;
+#endif /* OPT_A2 */
+#if OPT_A3
+	int fd;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -100,6 +112,9 @@ syscall(struct trapframe *tf)
 	 */
 
 	retval = 0;
+#ifdef OPT_A2
+	is64 = false;
+#endif /* OPT_A2 */
 
 	switch (callno) {
 	    case SYS_reboot:
@@ -138,10 +153,115 @@ syscall(struct trapframe *tf)
 	case SYS_fork:
 	  err = sys_fork(tf,(pid_t *)&retval);
 	  break;
+	case SYS_vfork:
+	  err = sys_vfork(tf,(pid_t *)&retval);
+	  break;
+	case SYS_getrusage:
+	  err = sys_getrusage((int)tf->tf_a0,(userptr_t)tf->tf_a1);
+	  break;
 	case SYS_execv:
 	  err = sys_execv((char *)tf->tf_a0,(char **)tf->tf_a1,(pid_t *)&retval);
 	  break;
+	case SYS_setaffinity:
+	  err = sys_setaffinity((unsigned int)tf->tf_a0);
+	  break;
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (mode_t)tf->tf_a2,
+			 &retval);
+	  break;
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 &retval);
+	  break;
+	case SYS_lseek:
+	  /* off_t is 64 bits: it goes in a2/a3, and whence on the stack */
+	  join32to64(tf->tf_a2, tf->tf_a3, &pos64);
+	  err = copyin((userptr_t)(tf->tf_sp + 16), &whence, sizeof(int));
+	  if (err) {
+	    break;
+	  }
+	  err = sys_lseek((int)tf->tf_a0, (off_t)pos64, whence, &retval64);
+	  is64 = true;
+	  break;
+	case SYS_readv:
+	  err = sys_readv((int)tf->tf_a0,
+			  (userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2,
+			  &retval);
+	  break;
+	case SYS_writev:
+	  err = sys_writev((int)tf->tf_a0,
+			   (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2,
+			   &retval);
+	  break;
+	/*
+	 * For the positional calls the off_t doesn't fit in a3 (it
+	 * needs an aligned register pair), so it's on the stack.
+	 */
+	case SYS_pread:
+	case SYS_pwrite:
+	case SYS_preadv:
+	case SYS_pwritev:
+	  err = copyin((userptr_t)(tf->tf_sp + 16), &pos, sizeof(pos));
+	  if (err) {
+	    break;
+	  }
+	  switch (callno) {
+	    case SYS_pread:
+	      err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			      (unsigned int)tf->tf_a2, pos, &retval);
+	      break;
+	    case SYS_pwrite:
+	      err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			       (unsigned int)tf->tf_a2, pos, &retval);
+	      break;
+	    case SYS_preadv:
+	      err = sys_preadv((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			       (int)tf->tf_a2, pos, &retval);
+	      break;
+	    case SYS_pwritev:
+	      err = sys_pwritev((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+				(int)tf->tf_a2, pos, &retval);
+	      break;
+	  }
+	  break;
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0, (int)tf->tf_a1, &retval);
+	  break;
 #endif /* OPT_A2 */
+#if OPT_A3
+	case SYS_sbrk:
+	  err = sys_sbrk((intptr_t)tf->tf_a0, (vaddr_t *)&retval);
+	  break;
+	case SYS_mmap:
+	  /* fd and the 64-bit offset are on the stack */
+	  err = copyin((userptr_t)(tf->tf_sp + 16), &fd, sizeof(int));
+	  if (err) {
+	    break;
+	  }
+	  err = copyin((userptr_t)(tf->tf_sp + 24), &pos, sizeof(pos));
+	  if (err) {
+	    break;
+	  }
+	  err = sys_mmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1,
+			 (int)tf->tf_a2, (int)tf->tf_a3, fd, pos,
+			 (vaddr_t *)&retval);
+	  break;
+	case SYS_munmap:
+	  err = sys_munmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1);
+	  break;
+	case SYS_fsync:
+	  err = sys_fsync((int)tf->tf_a0);
+	  break;
+#endif
 
 	default:
 	  kprintf("Unknown syscall %d\n", callno);
@@ -163,6 +283,12 @@ syscall(struct trapframe *tf)
 		/* Success. */
 		tf->tf_v0 = retval;
 		tf->tf_a3 = 0;      /* signal no error */
+#ifdef OPT_A2
+		if (is64) {
+			split64to32((uint64_t)retval64,
+				    &tf->tf_v0, &tf->tf_v1);
+		}
+#endif /* OPT_A2 */
 	}
 	
 	/*
@@ -194,6 +320,7 @@ enter_forked_process(void *tf, unsigned long as_address)
 #ifdef OPT_A2
 	// Copying to stack
 	struct trapframe stack_tf = *(struct trapframe *)tf;
+	kfree(tf);
 
 	// Set return to 0, a3 to 0 for success, increment pc
 	stack_tf.tf_v0 = 0;
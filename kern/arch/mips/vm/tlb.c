@@ -0,0 +1,436 @@
+/*
+ * MIPS TLB handling for the VM system: the TLB itself, each cpu's
+ * software TLB, and shootdowns. See vmprivate.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <cpu.h>
+#include <proc.h>
+#include <current.h>
+#include <mips/tlb.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * Software TLB. The hardware TLB is small, and refilling it through
+ * as_fault means taking mm_lock and looking the page up. Each cpu
+ * keeps a direct-mapped cache of the last SWTLB_SIZE translations it
+ * loaded, keyed by ASID and virtual page, and vm_fault tries that
+ * first: a hit reloads the TLB without taking any lock.
+ *
+ * An ASID names an address space's current set of translations. They
+ * are handed out in order, and when the 32-bit counter wraps every
+ * cache is cleared and every address space renumbered (see
+ * swtlb_flush), so no two address spaces share one and no cached entry
+ * outlives its ASID. Changing many translations at once (unmapping,
+ * shrinking the heap) gives the address space a new ASID, which
+ * orphans all its cached entries; taking a single page away drops its
+ * entry from every cpu's cache. Either is done with mm_lock held, as
+ * are all fills, so only readers run concurrently with them.
+ *
+ * Any other change keeps the page's frame and only makes it writeable
+ * (a clean page being dirtied, a shared mapped page being written), so
+ * a cached read-only entry on another cpu is still right, and a write
+ * through it faults as VM_FAULT_READONLY, which the cache leaves
+ * alone. The one exception is a page still mapped to zero_page, which
+ * gets a frame of its own on its first write without anyone telling
+ * the other cpus, so zero_page translations are never cached.
+ *
+ * The caches are allocated by each cpu when it first activates an
+ * address space. A cpu writes only its own cache, except to clear
+ * entries with mm_lock held.
+ */
+#define SWTLB_SIZE	256		/* a power of 2 */
+#define SWTLB_INDEX(va)	(((va) / PAGE_SIZE) & (SWTLB_SIZE - 1))
+
+struct swtlb_entry {
+	uint32_t se_asid;		/* 0 if empty */
+	vaddr_t se_vpage;
+	uint32_t se_elo;		/* what goes in the TLB */
+};
+
+struct swtlb {
+	struct swtlb_entry st_entries[SWTLB_SIZE];
+	unsigned st_hits;
+	unsigned st_misses;
+};
+
+static struct swtlb *swtlb[VM_MAXCPUS];
+static uint32_t as_nextasid = 1;	/* 0 is never an ASID */
+
+/*
+ * Shootdowns. Other cpus that have an address space active (per
+ * cpu_curas) have its pages shot down from their TLBs; this cpu's TLB
+ * is fixed up directly. Shootdowns are batched, up to TLBSHOOTDOWN_MAX
+ * pages going with one IPI to each cpu that needs any of them.
+ */
+static struct addrspace *cpu_curas[VM_MAXCPUS];
+
+/* Protected by mm_lock */
+static unsigned vm_shoot_batches;	/* shootdowns sent */
+static unsigned vm_shoot_ipis;		/* ...and IPIs they took */
+
+/* Shootdowns received, by cpu; each written only by its own cpu */
+static unsigned vm_shoot_pages[VM_MAXCPUS];	/* TLB pages dropped */
+static unsigned vm_shoot_flushes[VM_MAXCPUS];	/* whole TLBs dropped */
+
+/*
+ * Make AS the address space this cpu's TLB holds, and throw out what
+ * it held before.
+ */
+void
+tlb_activate(struct addrspace *as)
+{
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	/* Tell the page-out code whose pages this TLB may now hold. */
+	cpu_curas[curcpu->c_number] = as;
+	if (swtlb[curcpu->c_number] == NULL) {
+		/* if this fails, we'll just try again next time */
+		swtlb[curcpu->c_number] = kmalloc(sizeof(struct swtlb));
+		if (swtlb[curcpu->c_number] != NULL) {
+			bzero(swtlb[curcpu->c_number], sizeof(struct swtlb));
+		}
+	}
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+
+	splx(spl);
+}
+
+/*
+ * Remove any TLB entries for pages in START..END-1 on this cpu. This
+ * looks at every entry rather than probing for every page, since the
+ * range may be far bigger than the TLB, and pages that have only been
+ * read may be mapped to zero_page without us keeping track of them.
+ */
+void
+tlb_unmap(vaddr_t start, vaddr_t end)
+{
+	uint32_t ehi, elo;
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if ((elo & TLBLO_VALID) == 0) {
+			continue;
+		}
+		ehi &= TLBHI_VPAGE;
+		if (ehi >= start && ehi < end) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+	}
+	splx(spl);
+}
+
+/*
+ * Try to refill the TLB for VADDR from this cpu's cache. A write
+ * through a read-only entry is left to vm_fault proper.
+ */
+bool
+swtlb_refill(int faulttype, vaddr_t vaddr)
+{
+	struct addrspace *as;
+	struct swtlb *st;
+	struct swtlb_entry *se;
+	uint32_t asid;
+	bool hit = false;
+	int spl;
+
+	if (faulttype == VM_FAULT_READONLY || curproc == NULL) {
+		return false;
+	}
+	/* Only this thread changes it, so no need for p_lock. */
+	as = curproc->p_addrspace;
+	if (as == NULL) {
+		return false;
+	}
+
+	spl = splhigh();
+	/* before the entry; see swtlb_flush */
+	asid = as->as_asid;
+	st = swtlb[curcpu->c_number];
+	if (st != NULL) {
+		se = &st->st_entries[SWTLB_INDEX(vaddr)];
+		if (se->se_asid == asid && se->se_vpage == vaddr &&
+		    (faulttype == VM_FAULT_READ ||
+		     (se->se_elo & TLBLO_DIRTY) != 0)) {
+			/* a miss means there's no entry to replace */
+			tlb_random(vaddr, se->se_elo);
+			hit = true;
+			st->st_hits++;
+		}
+		else {
+			st->st_misses++;
+		}
+	}
+	splx(spl);
+	return hit;
+}
+
+/*
+ * Remember a translation just loaded for AS. Caller holds mm_lock,
+ * and is at splhigh.
+ */
+static
+void
+swtlb_fill(struct addrspace *as, vaddr_t vaddr, uint32_t elo)
+{
+	struct swtlb *st = swtlb[curcpu->c_number];
+	struct swtlb_entry *se;
+
+	if (st == NULL) {
+		return;
+	}
+	se = &st->st_entries[SWTLB_INDEX(vaddr)];
+	se->se_asid = as->as_asid;
+	se->se_vpage = vaddr;
+	se->se_elo = elo;
+}
+
+/*
+ * Drop any cached translation for page VADDR of AS, on every cpu.
+ * Caller holds mm_lock.
+ */
+static
+void
+swtlb_invalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	struct swtlb_entry *se;
+	unsigned i;
+
+	for (i=0; i<VM_MAXCPUS; i++) {
+		if (swtlb[i] == NULL) {
+			continue;
+		}
+		se = &swtlb[i]->st_entries[SWTLB_INDEX(vaddr)];
+		if (se->se_asid == as->as_asid && se->se_vpage == vaddr) {
+			se->se_asid = 0;
+		}
+	}
+}
+
+/*
+ * Drop all of AS's cached translations, by giving it a new ASID.
+ * Caller holds mm_lock, so no cache is being filled.
+ *
+ * If the counter has wrapped, clear every cache and then renumber
+ * every address space from 1. Clearing first means a refill that
+ * reads a new ASID can only find an empty entry.
+ */
+void
+swtlb_flush(struct addrspace *as)
+{
+	struct addrspace *a;
+	unsigned i, j;
+
+	KASSERT(lock_do_i_hold(mm_lock));
+
+	spinlock_acquire(&as_all_lock);
+	if (as_nextasid == 0) {
+		for (i=0; i<VM_MAXCPUS; i++) {
+			if (swtlb[i] == NULL) {
+				continue;
+			}
+			for (j=0; j<SWTLB_SIZE; j++) {
+				swtlb[i]->st_entries[j].se_asid = 0;
+			}
+		}
+		as_nextasid = 1;
+		for (a = as_all; a != NULL; a = a->as_next) {
+			a->as_asid = as_nextasid++;
+		}
+	}
+	as->as_asid = as_nextasid++;
+	spinlock_release(&as_all_lock);
+}
+
+/*
+ * Load a TLB entry for VADDR of AS, replacing any existing one, and
+ * cache it. Caller holds mm_lock.
+ */
+void
+tlb_load(struct addrspace *as, vaddr_t vaddr, paddr_t paddr, bool writeable)
+{
+	uint32_t ehi, elo;
+	int i, spl;
+
+	spl = splhigh();
+	ehi = vaddr;
+	elo = paddr | TLBLO_VALID;
+	if (writeable) {
+		elo |= TLBLO_DIRTY;
+	}
+	i = tlb_probe(ehi, 0);
+	if (i < 0) {
+		for (i=0; i<NUM_TLB; i++) {
+			uint32_t oehi, oelo;
+
+			tlb_read(&oehi, &oelo, i);
+			if ((oelo & TLBLO_VALID) == 0) {
+				break;
+			}
+		}
+	}
+	if (i < NUM_TLB) {
+		tlb_write(ehi, elo, i);
+	}
+	else {
+		tlb_random(ehi, elo);
+	}
+	if (paddr != zero_page) {
+		/* see above */
+		swtlb_fill(as, vaddr, elo);
+	}
+	splx(spl);
+}
+
+/*
+ * The other cpus that may have TLB entries for AS, as a CPU_MASKBIT
+ * mask.
+ */
+static
+uint32_t
+as_cpumask(struct addrspace *as)
+{
+	uint32_t mask = 0;
+	unsigned i;
+
+	for (i=0; i<VM_MAXCPUS; i++) {
+		if (cpu_curas[i] == as && i != curcpu->c_number) {
+			mask |= (uint32_t)1 << i;
+		}
+	}
+	return mask;
+}
+
+void
+shoot_init(struct shootbatch *sb)
+{
+	sb->sb_n = 0;
+	sb->sb_cpus = 0;
+}
+
+/*
+ * Send the batch, and wait for it to be done.
+ */
+void
+shoot_flush(struct shootbatch *sb)
+{
+	KASSERT(lock_do_i_hold(mm_lock));
+
+	if (sb->sb_n > 0) {
+		vm_shoot_ipis += ipi_tlbshootdown_mask(sb->sb_cpus,
+						       sb->sb_maps, sb->sb_n);
+		vm_shoot_batches++;
+	}
+	shoot_init(sb);
+}
+
+/*
+ * Add page VADDR of AS to the batch if any other cpu has AS active,
+ * sending the batch if it's full. Its cached translations should
+ * already have been dropped, so that a cpu that switches to AS after
+ * this looks is sure to miss.
+ */
+static
+void
+shoot_add(struct shootbatch *sb, struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t mask;
+
+	mask = as_cpumask(as);
+	if (mask == 0) {
+		return;
+	}
+	if (sb->sb_n == TLBSHOOTDOWN_MAX) {
+		shoot_flush(sb);
+	}
+	sb->sb_maps[sb->sb_n].ts_addrspace = as;
+	sb->sb_maps[sb->sb_n].ts_vaddr = vaddr;
+	sb->sb_n++;
+	sb->sb_cpus |= mask;
+}
+
+/*
+ * Take page VADDR of AS out of every cache and TLB. The cached
+ * translation goes first: a cpu that switches to AS meanwhile either
+ * shows up in cpu_curas or misses in its cache.
+ */
+void
+shoot_page(struct shootbatch *sb, struct addrspace *as, vaddr_t vaddr)
+{
+	swtlb_invalidate(as, vaddr);
+	shoot_add(sb, as, vaddr);
+	if (as == cpu_curas[curcpu->c_number]) {
+		tlb_unmap(vaddr, vaddr + PAGE_SIZE);
+	}
+}
+
+void
+tlb_printstats(void)
+{
+	unsigned i, hits, misses, pages, flushes;
+
+	hits = misses = 0;
+	for (i=0; i<VM_MAXCPUS; i++) {
+		if (swtlb[i] != NULL) {
+			hits += swtlb[i]->st_hits;
+			misses += swtlb[i]->st_misses;
+		}
+	}
+	kprintf("VM: software TLB: %u hits, %u misses\n", hits, misses);
+	pages = flushes = 0;
+	for (i=0; i<VM_MAXCPUS; i++) {
+		pages += vm_shoot_pages[i];
+		flushes += vm_shoot_flushes[i];
+	}
+	kprintf("VM: TLB shootdown: %u batches in %u IPIs; "
+		"%u pages and %u whole TLBs dropped\n",
+		vm_shoot_batches, vm_shoot_ipis, pages, flushes);
+}
+
+void
+vm_tlbshootdown_all(void)
+{
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	vm_shoot_flushes[curcpu->c_number]++;
+	splx(spl);
+}
+
+void
+vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+	int i, spl;
+
+	spl = splhigh();
+	/* A batch goes to every cpu that needs any of it. */
+	if (ts->ts_addrspace == cpu_curas[curcpu->c_number]) {
+		i = tlb_probe(ts->ts_vaddr, 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+		vm_shoot_pages[curcpu->c_number]++;
+	}
+	splx(spl);
+}
+
+#endif /* OPT_A3 */
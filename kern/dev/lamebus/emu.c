@@ -837,13 +837,16 @@ emufs_namefile(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_MMAP
+ *
+ * The VM system does the work, reading and writing pages with
+ * VOP_READ and VOP_WRITE, so files can always be mapped.
  */
 static
 int
 emufs_mmap(struct vnode *v)
 {
 	(void)v;
-	return EUNIMP;
+	return 0;
 }
 
 //////////////////////////////
@@ -36,8 +36,15 @@
 
 
 #include <vm.h>
+#include "opt-A3.h"
 
 struct vnode;
+#if OPT_A3
+struct pagetable;
+struct segload;
+struct textseg;
+struct mmregion;
+#endif
 
 
 /* 
@@ -49,12 +56,42 @@ struct vnode;
 
 struct addrspace {
   vaddr_t as_vbase1;
+#if !OPT_A3
   paddr_t as_pbase1;
+#endif
   size_t as_npages1;
   vaddr_t as_vbase2;
+#if !OPT_A3
   paddr_t as_pbase2;
+#endif
   size_t as_npages2;
+#if !OPT_A3
   paddr_t as_stackpbase;
+#else
+  struct pagetable *as_pt;	/* regions, stack and heap */
+  bool as_writeable1;
+  bool as_writeable2;
+  struct textseg *as_text1;	/* text, if read-only */
+  struct textseg *as_text2;
+  struct segload *as_load1;	/* if writeable: where pages come from */
+  struct segload *as_load2;
+  vaddr_t as_heapbase;		/* start of heap, above the regions */
+  vaddr_t as_heaptop;		/* the break */
+  struct mmregion *as_mmaps;	/* mmap regions, highest first */
+
+  /* Working set and fault rate, for page replacement and reports */
+  unsigned as_rss;		/* pageable pages in memory */
+  unsigned as_faults;		/* pages brought in, all told */
+  unsigned as_pfffaults;	/* pages brought in this window */
+  unsigned as_pffstart;		/* tick the window began */
+  unsigned as_pffrate;		/* pages in per second, last window */
+  int as_pri;			/* priority of the thread last faulting */
+  bool as_suspended;		/* asleep for load control */
+  unsigned as_seq;		/* creation order */
+  uint32_t as_asid;		/* names its cached translations */
+  char as_name[16];		/* process using it, for reports */
+  struct addrspace *as_next;	/* on the list of all address spaces */
+#endif
 };
 
 /*
@@ -91,6 +128,33 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_share_text - called between as_define_region and
+ *                as_prepare_load with the executable being loaded.
+ *                Maps in any read-only region that another process
+ *                running the same executable already has in memory.
+ *
+ *    as_define_file - called between as_prepare_load and
+ *                as_complete_load for each segment of the executable.
+ *                Records where the segment comes from in the file;
+ *                its pages are read in (or zeroed, past FILESIZE) on
+ *                first touch rather than now.
+ *
+ *    as_sbrk   - move the break (the top of the heap) by AMOUNT bytes
+ *                and hand back the old one. Heap pages are zero-filled
+ *                on first touch, and given back when the heap shrinks
+ *                past them.
+ *
+ *    as_mmap   - map LEN bytes of the file V (or zeroes, if V is NULL)
+ *                from OFFSET, at ADDR if MAP_FIXED is given and
+ *                otherwise wherever there's room below the stack.
+ *                Hands back the address used. Pages are read in on
+ *                first touch; MAP_SHARED changes go back to the file.
+ *
+ *    as_munmap - remove any mappings in the given range.
+ *
+ *    mmap_fsync - write back the changed pages of any shared mapping
+ *                of V. Called from fsync().
  */
 
 struct addrspace *as_create(void);
@@ -107,6 +171,19 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+#if OPT_A3
+void              as_share_text(struct addrspace *as, struct vnode *v);
+int               as_define_file(struct addrspace *as, struct vnode *v,
+                                 off_t offset, vaddr_t vaddr,
+                                 size_t memsize, size_t filesize);
+int               as_sbrk(struct addrspace *as, intptr_t amount,
+                          vaddr_t *oldbreak);
+int               as_mmap(struct addrspace *as, vaddr_t addr, size_t len,
+                          int prot, int flags, struct vnode *v,
+                          off_t offset, vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+void              mmap_fsync(struct vnode *v);
+#endif
 
 
 /*
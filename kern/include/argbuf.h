@@ -0,0 +1,46 @@
+#ifndef _ARGBUF_H_
+#define _ARGBUF_H_
+
+/*
+ * Staging buffer for program arguments, used by execv and runprogram.
+ *
+ * The argument strings are gathered into a single ARG_MAX buffer and
+ * then laid out there exactly as they will appear on the new user
+ * stack -- the strings, then the argv pointer array -- so putting them
+ * on the stack is one copyout.
+ *
+ * A caller keeps its buffer from gathering the arguments until they
+ * are copied out (across loading the new executable). Each exec
+ * allocates a buffer of its own, so execs don't wait for each other.
+ * Without OPT_A3, dumbvm can't give back multi-page allocations, so
+ * there is instead only one buffer and argbuf_create waits for it:
+ * execs then marshal their arguments one at a time, but never leak 64K
+ * of kernel memory each.
+ *
+ * Operations:
+ *    argbuf_bootstrap - set up at boot.
+ *    argbuf_create    - get a buffer (waiting for it, without OPT_A3).
+ *                       NULL if out of memory.
+ *    argbuf_copyin    - gather the NULL-terminated user argv UARGV.
+ *    argbuf_load      - gather the kernel strings ARGS[0..ARGC-1].
+ *    argbuf_copyout   - place the arguments just below *STACKPTR, and
+ *                       return the new stack pointer, the user address
+ *                       of argv, and argc.
+ *    argbuf_destroy   - give the buffer back.
+ *
+ * argbuf_copyin and argbuf_load fail with E2BIG if the strings plus
+ * the argv array won't fit in ARG_MAX bytes.
+ */
+
+struct argbuf;
+
+void argbuf_bootstrap(void);
+struct argbuf *argbuf_create(void);
+int argbuf_copyin(struct argbuf *ab, userptr_t uargv);
+int argbuf_load(struct argbuf *ab, char **args, int argc);
+int argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr,
+		   userptr_t *uargv, int *argc);
+void argbuf_destroy(struct argbuf *ab);
+
+
+#endif /* _ARGBUF_H_ */
@@ -33,6 +33,7 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <thread.h>      /* for NPRI */
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,14 +60,25 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct thread *c_handoff;	/* Thread to requeue on another cpu */
+	struct thread *c_idlethread;	/* Runs while c_handoff moves off */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
+	 *
+	 * There is one run queue per priority level. Bit N of
+	 * c_runbits is set if and only if c_runqueue[N] is nonempty,
+	 * so the most important runnable thread can be found without
+	 * looking at the queues at all.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[NPRI];	/* Run queues for this cpu */
+	uint32_t c_runbits;		/* Nonempty run queues */
+	unsigned c_runcount;		/* Threads on all run queues */
+	bool c_runstale;		/* A queued thread changed priority */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -82,15 +94,24 @@ struct cpu {
 	 * struct tlbshootdown is machine-dependent and might
 	 * reasonably be either an address space and vaddr pair, or a
 	 * paddr, or something else.
+	 *
+	 * Each batch of shootdowns queued gets a ticket from
+	 * c_shootdown_req; c_shootdown_done is the last ticket dealt
+	 * with, so a sender can wait for its batch to be finished.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+	unsigned c_shootdown_req;
+	volatile unsigned c_shootdown_done;
 	struct spinlock c_ipi_lock;
 };
 
 #define TLBSHOOTDOWN_ALL  (-1)
 
+/* This cpu's bit in a thread's affinity mask (t_cpumask). */
+#define CPU_MASKBIT(c)  ((uint32_t)1 << (c)->c_number)
+
 /*
  * Initialization functions.
  * 
@@ -152,6 +173,12 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * No IPI is sent if the target already has shootdowns pending; they
+ * are all dealt with together.
+ * ipi_tlbshootdown_mask queues the N mappings in MAPPINGS for every
+ * CPU in CPUMASK (bits as in CPU_MASKBIT) except the current one,
+ * sending each at most one IPI, and waits until they've all been
+ * dealt with. Returns the number of IPIs sent.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +193,8 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown_mask(uint32_t cpumask,
+			       const struct tlbshootdown *mappings, unsigned n);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,21 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap(). These are shared between the kernel and
+ * userland (see <sys/mman.h>).
+ */
+
+/* Protection: what the mapping may be used for */
+#define PROT_NONE	0x0
+#define PROT_READ	0x1
+#define PROT_WRITE	0x2
+#define PROT_EXEC	0x4
+
+/* Flags: exactly one of MAP_SHARED and MAP_PRIVATE is required */
+#define MAP_SHARED	0x0001	/* changes are seen by others, and the file */
+#define MAP_PRIVATE	0x0002	/* changes are ours alone */
+#define MAP_FIXED	0x0010	/* put it exactly at ADDR */
+#define MAP_ANON	0x1000	/* not backed by a file; starts zeroed */
+
+#endif /* _KERN_MMAN_H_ */
@@ -67,6 +67,8 @@ struct rusage {
 	__counter_t ru_nsignals;	/* signals delivered (count) */
 	__counter_t ru_nvcsw;		/* voluntary context switches (count)*/
 	__counter_t ru_nivcsw;		/* involuntary ditto (count) */
+	__u64 ru_inbytes;		/* bytes read (OS/161 extension) */
+	__u64 ru_outbytes;		/* bytes written (ditto) */
 };
 
 /* limit codes for getrusage/setrusage */
@@ -0,0 +1,66 @@
+#ifndef _OPENFILE_H_
+#define _OPENFILE_H_
+
+/*
+ * Open files and file descriptor tables.
+ *
+ * An openfile is what open() creates: a vnode plus the access mode
+ * and seek position. File descriptors refer to openfiles, and several
+ * descriptors (from dup2, or in different processes after fork) can
+ * share one, and with it the seek position.
+ *
+ * of_lock is held across each read, write, or seek, which makes the
+ * offset update atomic with the I/O. The other fields are fixed once
+ * the openfile is created, apart from the reference count, which is
+ * protected by of_reflock.
+ */
+
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+struct proc;
+
+struct openfile {
+	struct vnode *of_vnode;		/* The file */
+	int of_flags;			/* Open flags (O_ACCMODE, O_APPEND) */
+	off_t of_offset;		/* Seek position */
+	struct lock *of_lock;		/* Serializes I/O and seeks */
+	unsigned of_refcount;		/* Number of fds referring to us */
+	struct spinlock of_reflock;	/* Protects of_refcount */
+};
+
+/*
+ * Openfile operations.
+ *    openfile_open   - open PATH (a kernel string, which may be
+ *                      destroyed) with open() FLAGS and MODE.
+ *    openfile_incref - add a reference.
+ *    openfile_decref - drop a reference, closing the file if it was
+ *                      the last one.
+ */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * File descriptor table operations. The table lives in struct proc
+ * (p_fds) and is only touched by the process's own thread, apart from
+ * fdtable_copy, which the parent does for a child that isn't running
+ * yet.
+ *    fd_get       - look up FD; EBADF if it isn't open.
+ *    fd_alloc     - install OF (taking over the caller's reference) at
+ *                   the lowest free fd; EMFILE if there isn't one.
+ *    fd_close     - close FD; EBADF if it isn't open.
+ *    fdtable_copy - give TO a reference to each of FROM's open files.
+ *    fdtable_closeall - close everything, at process exit.
+ *    fdtable_stdio - open the console as fds 0, 1, and 2.
+ */
+int fd_get(struct proc *p, int fd, struct openfile **ret);
+int fd_alloc(struct proc *p, struct openfile *of, int *fd);
+int fd_close(struct proc *p, int fd);
+void fdtable_copy(struct proc *from, struct proc *to);
+void fdtable_closeall(struct proc *p);
+int fdtable_stdio(struct proc *p);
+
+
+#endif /* _OPENFILE_H_ */
@@ -0,0 +1,59 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+/*
+ * Two-level page tables.
+ *
+ * A user address is split 10/10/12: the top bits index the directory,
+ * the next 10 a second-level table of PT_NPTES entries, and the rest
+ * are the offset in the page. A second-level table is only made when
+ * something in the 4M of address space it covers is used, so a sparse
+ * address space costs little, and finding an entry is two array
+ * lookups however large the address space is.
+ *
+ * An entry (pte_t) is 0 for a page that has never been touched.
+ * Otherwise the top 20 bits are the page's frame, if PTE_VALID is set,
+ * or its swap slot, if PTE_SWAPPED is.
+ */
+
+#include <machine/vm.h>
+
+typedef uint32_t pte_t;
+
+#define PTE_VALID	0x001	/* in memory; top bits are the frame */
+#define PTE_SWAPPED	0x002	/* in swap; top bits are the slot */
+#define PTE_DIRTY	0x004	/* written since it was filled in */
+#define PTE_READONLY	0x008	/* never map it writeable */
+#define PTE_FRAME	0xfffff000
+
+#define PTE_MKSWAP(slot)	(((pte_t)(slot) << 12) | PTE_SWAPPED)
+#define PTE_SLOT(pte)		((pte) >> 12)
+
+#define PT_NPTES	1024			/* entries per table */
+#define PT_SPAN		(PT_NPTES * PAGE_SIZE)	/* bytes one table maps */
+
+struct pagetable;
+
+/*
+ * Operations:
+ *    pt_create  - make an empty page table. NULL if out of memory.
+ *    pt_destroy - free a page table. Whatever its entries refer to
+ *                 should have been dealt with already.
+ *    pt_lookup  - the entry for VADDR, or NULL if there is no table
+ *                 for it yet (so it would be 0).
+ *    pt_alloc   - the entry for VADDR, making the table for it if need
+ *                 be. NULL if out of memory.
+ *    pt_foreach - call FUNC(DATA, vaddr, entry) for every nonzero entry
+ *                 for START..END-1, in order. Stops at the first
+ *                 nonzero return from FUNC and returns that.
+ */
+struct pagetable *pt_create(void);
+void pt_destroy(struct pagetable *pt);
+pte_t *pt_lookup(struct pagetable *pt, vaddr_t vaddr);
+pte_t *pt_alloc(struct pagetable *pt, vaddr_t vaddr);
+int pt_foreach(struct pagetable *pt, vaddr_t start, vaddr_t end,
+	       int (*func)(void *data, vaddr_t vaddr, pte_t *pte),
+	       void *data);
+
+
+#endif /* _PAGETABLE_H_ */
@@ -38,13 +38,14 @@
 
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#include <limits.h> /* for OPEN_MAX */
 #include "opt-A2.h"
 
 struct addrspace;
 struct vnode;
-#ifdef UW
+#if defined(UW) || defined(OPT_A2)
 struct semaphore;
-#endif // UW
+#endif
 
 /*
  * Process structure.
@@ -72,7 +73,12 @@ struct proc {
 	/* add more material here as needed */
 #ifdef OPT_A2
 	pid_t pid;
-	int index;
+	struct proc_holder *holder;	/* our entry in the process table */
+	struct openfile *p_fds[OPEN_MAX]; /* file descriptor table */
+	struct semaphore *p_vforksem;	/* vfork parent waiting for its
+					   address space back, or NULL */
+	struct thread_usage p_usage;	/* of our exited threads */
+	struct thread_usage p_childusage; /* of our exited children */
 #endif /* OPT2_A2 */
 };
 
@@ -106,28 +112,28 @@ struct addrspace *curproc_getas(void);
 struct addrspace *curproc_setas(struct addrspace *);
 
 #ifdef OPT_A2
-#define MAX_PROCS 512 // 30k is too much...
 struct proc_holder {
     pid_t pid;
-	pid_t parent_pid;
-	bool in_use;
-	int exitcode;
-	struct semaphore *sem;
-	struct proc *p;
+	int exitcode;			/* wait status, once exited */
+	bool exited;
+	struct proc *p;			/* NULL once the process has exited */
+	struct proc_holder *parent;	/* NULL if none or orphaned */
+	struct proc_holder *children;	/* our children, live or exited */
+	struct proc_holder *sibling;	/* next child of our parent */
+	struct proc_holder *next;	/* pid hash chain */
 };
 
-// Helper functions for task_manager
+// Helper functions for the process table
 void print_task_manager(void);
-int genPID(void);
-int findPID(int pid);
-int make_proc_holder(struct proc *p);
-int get_ph_parent_pid(int index);
-void set_ph_parent_pid(int index, int parent_pid);
-void set_ph_not_in_use(int index);
-int get_ph_exitcode(int index);
-void set_ph_exitcode(int index, int exitcode);
-void p_ph_sem(int index);
-void v_ph_sem(int index);
+struct proc_holder *findPID(pid_t pid);
+struct proc_holder *make_proc_holder(struct proc *p);
+void free_proc_holder(struct proc_holder *ph);
+void proc_addchild(struct proc *parent, struct proc *child);
+void proc_holder_exit(struct proc_holder *ph, int waitstatus,
+		      const struct thread_usage *usage);
+void proc_childusage(struct proc *p, struct thread_usage *ret);
+int proc_holder_wait(struct proc_holder *parent, pid_t pid, int options,
+		     int *status, pid_t *retpid);
 
 #endif /* OPT2_A2 */
 
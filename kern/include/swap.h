@@ -0,0 +1,33 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space.
+ *
+ * Pages are paged out to the raw disk SWAP_DEVICE, one page per slot.
+ * A bitmap records which slots are in use. If there's no such disk,
+ * there's no swap space and swap_alloc always fails.
+ */
+
+#define SWAP_DEVICE	"lhd0raw:"
+
+/*
+ * Operations:
+ *    swap_bootstrap - open the swap disk. Called from vm_bootstrap.
+ *    swap_alloc     - allocate a slot. Returns ENOSPC if there are none.
+ *    swap_free      - free a slot.
+ *    swap_nfree     - number of free slots.
+ *    swap_read      - read a slot into physical page PADDR.
+ *    swap_write     - write N physical pages PADDRS[] out to slots
+ *                     SLOTS[]. Runs of consecutive slots go to the
+ *                     disk in a single write.
+ */
+void swap_bootstrap(void);
+int swap_alloc(unsigned *slot);
+void swap_free(unsigned slot);
+unsigned swap_nfree(void);
+int swap_read(unsigned slot, paddr_t paddr);
+int swap_write(const paddr_t *paddrs, const unsigned *slots, unsigned n);
+
+
+#endif /* _SWAP_H_ */
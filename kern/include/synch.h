@@ -62,6 +62,13 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * P_timed is P with a deadline: if the count doesn't become nonzero
+ * within TICKS hardclock ticks (HZ per second), give up and return
+ * ETIMEDOUT without decrementing. Returns 0 on success.
+ */
+int P_timed(struct semaphore *, unsigned ticks);
+
 
 /*
  * Simple lock for mutual exclusion.
@@ -78,6 +85,8 @@ struct lock {
         struct spinlock lk_lock;
         volatile int lk_value;
         struct thread *lk_owner;
+        struct lock *lk_heldnext;       /* next lock held by lk_owner */
+        struct thread *lk_waiters;      /* threads blocked on this lock */
 };
 
 struct lock *lock_create(const char *name);
@@ -98,6 +107,19 @@ void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
 
+/*
+ * Priority inheritance.
+ *
+ * A thread that blocks in lock_acquire lends its effective priority
+ * to the lock's owner, and transitively to whatever that owner is
+ * itself blocked on. The loan is returned in lock_release.
+ *
+ *    lock_pi_recompute - recompute the current thread's effective
+ *                   priority from its base priority and the threads
+ *                   waiting on the locks it holds.
+ */
+void lock_pi_recompute(void);
+
 
 /*
  * Condition variable.
@@ -125,6 +147,9 @@ void cv_destroy(struct cv *);
  * Operations:
  *    cv_wait      - Release the supplied lock, go to sleep, and, after
  *                   waking up again, re-acquire the lock.
+ *    cv_timedwait - Like cv_wait, but stop sleeping after TICKS
+ *                   hardclock ticks. The lock is re-acquired either
+ *                   way. Returns 0 if signalled and ETIMEDOUT if not.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
@@ -135,6 +160,7 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
@@ -30,6 +30,7 @@
 #ifndef _SYSCALL_H_
 #define _SYSCALL_H_
 #include "opt-A2.h"
+#include "opt-A3.h"
 struct trapframe; /* from <machine/trapframe.h> */
 
 /*
@@ -60,6 +61,7 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 void sys__exit(int exitcode);
+void proc_exit(int waitstatus);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
@@ -67,6 +69,30 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
 #ifdef OPT_A2
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_getrusage(int who, userptr_t uusage);
 int sys_execv(char *program, char **args, pid_t *retval);
+int sys_setaffinity(unsigned int cpumask);
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	      int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	       int *retval);
+int sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fdesc, userptr_t iov, int iovcnt, off_t pos, int *retval);
+int sys_pwritev(int fdesc, userptr_t iov, int iovcnt, off_t pos, int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_close(int fdesc);
+int sys_dup2(int oldfd, int newfd, int *retval);
 #endif // OPT_A2
+
+#if OPT_A3
+int sys_sbrk(intptr_t amount, vaddr_t *retval);
+int sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, vaddr_t *retval);
+int sys_munmap(vaddr_t addr, size_t len);
+int sys_fsync(int fdesc);
+#endif
 #endif /* _SYSCALL_H_ */
@@ -58,9 +58,13 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
+int threadtest5(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int pitest(int, char **);
+int twtest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -64,6 +64,43 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Scheduling priorities. Larger numbers are more important. A new
+ * thread starts out with the base priority of the thread that forked
+ * it.
+ */
+#define PRI_MIN		0
+#define PRI_MAX		31
+#define PRI_DEFAULT	16
+#define NPRI		(PRI_MAX - PRI_MIN + 1)
+
+/*
+ * CPU affinity masks have one bit per cpu number, so at most 32 cpus
+ * are supported. A new thread inherits its parent's mask.
+ */
+#define CPUMASK_ALL	0xffffffffU
+
+/* Names shorter than this are kept in the thread itself. */
+#define THREAD_NAMEBUF	32
+
+/*
+ * Resource usage counters, kept per thread and summed into the
+ * process for getrusage. Only the thread itself (or hardclock, on the
+ * thread's own cpu) updates them, so they need no locking.
+ */
+struct thread_usage {
+	unsigned tu_uticks;		/* hardclocks taken in user mode */
+	unsigned tu_sticks;		/* hardclocks taken in the kernel */
+	unsigned tu_minflt;		/* page faults needing no I/O */
+	unsigned tu_majflt;		/* page faults that read a file */
+	unsigned tu_nvcsw;		/* switches from going to sleep */
+	unsigned tu_nivcsw;		/* switches from yielding */
+	unsigned tu_inblock;		/* file reads */
+	unsigned tu_oublock;		/* file writes */
+	uint64_t tu_inbytes;		/* bytes read */
+	uint64_t tu_outbytes;		/* bytes written */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -71,6 +108,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[THREAD_NAMEBUF];	/* Storage for short names */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -82,7 +120,10 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	uint32_t t_cpumask;		/* CPUs thread may run on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
+	bool t_timedout;		/* Timed sleep ended by the timer */
 
 	/*
 	 * Interrupt state fields.
@@ -101,6 +142,26 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Priority fields.
+	 *
+	 * t_basepri is the priority the thread asked for. t_pri is the
+	 * priority it is scheduled at; it can be raised above t_basepri
+	 * by priority inheritance while the thread holds a lock that a
+	 * more important thread is waiting for. The lock-related
+	 * fields are managed by synch.c and are protected by its
+	 * priority-inheritance spinlock.
+	 */
+	int t_basepri;			/* Base priority */
+	int t_pri;			/* Effective priority */
+	struct lock *t_waitlock;	/* Lock we are blocked on, if any */
+	struct thread *t_lkwaitnext;	/* Next thread blocked on t_waitlock */
+	struct lock *t_heldlocks;	/* Locks we hold (via lk_heldnext) */
+
+	/* Accounting */
+	struct thread_usage t_usage;	/* What we've used so far */
+	bool t_intr_user;		/* Interrupt came from user mode */
+
 	/*
 	 * Public fields
 	 */
@@ -157,6 +218,33 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the base priority of the current thread, which must be between
+ * PRI_MIN and PRI_MAX. The effective priority may stay higher while
+ * the thread holds locks that more important threads are waiting for.
+ */
+void thread_setpriority(int pri);
+
+/*
+ * Restrict the current thread to the cpus whose bits are set in MASK
+ * (bit N is cpu number N). Bits for cpus that don't exist are
+ * ignored; returns EINVAL if that leaves none. If the current cpu is
+ * excluded the thread has moved off it by the time this returns.
+ */
+int thread_setaffinity(uint32_t mask);
+
+/*
+ * Note that the effective priority of thread T has just been raised
+ * by priority inheritance, so that if T is waiting on a run queue the
+ * next schedule() on its cpu moves it to the right one.
+ */
+void thread_priority_changed(struct thread *t);
+
+/*
+ * Add the usage counts in FROM to TO.
+ */
+void thread_usage_add(struct thread_usage *to, const struct thread_usage *from);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
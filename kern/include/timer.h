@@ -0,0 +1,52 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers (callouts).
+ *
+ * A timer calls a function once, a given number of hardclock ticks
+ * (HZ per second) from now. Timers are kept on a hierarchical timer
+ * wheel that is advanced by hardclock() on cpu 0, so starting,
+ * stopping, and expiring a timer are all constant-time no matter how
+ * many timers are outstanding.
+ *
+ * The callback runs in interrupt context, with no spinlocks held. It
+ * must not sleep. It may restart its own timer, but it must not call
+ * timer_stop on it.
+ *
+ * struct timer is exposed so callers can embed it (or put it on the
+ * stack) instead of allocating one; treat its fields as private.
+ */
+
+struct timer {
+	struct timer *tm_next;		/* Next timer in wheel slot */
+	struct timer **tm_pprev;	/* Link pointing to us; NULL if idle */
+	unsigned tm_expires;		/* Tick on which to fire */
+	void (*tm_func)(void *);	/* Callback */
+	void *tm_data;			/* Argument to callback */
+};
+
+/*
+ * Operations:
+ *    timer_init  - set up a timer that will call FUNC(DATA).
+ *    timer_start - (re)arm the timer to fire TICKS ticks from now. If
+ *                  it was already pending, the old deadline is
+ *                  forgotten. A TICKS of 0 fires on the next tick.
+ *    timer_stop  - disarm the timer. Returns true if it was pending
+ *                  (and so the callback will now never run). If the
+ *                  callback is running on another cpu, waits for it
+ *                  to finish, so after timer_stop returns the timer
+ *                  may be freed.
+ *    timer_ticks - the number of ticks the wheel has advanced since
+ *                  boot. Wraps around; compare with subtraction.
+ *    timer_tick  - advance the wheel by one tick and run whatever
+ *                  expires. Called from hardclock().
+ */
+void timer_init(struct timer *tm, void (*func)(void *), void *data);
+void timer_start(struct timer *tm, unsigned ticks);
+bool timer_stop(struct timer *tm);
+unsigned timer_ticks(void);
+void timer_tick(void);
+
+
+#endif /* _TIMER_H_ */
@@ -0,0 +1,270 @@
+#ifndef _VMPRIVATE_H_
+#define _VMPRIVATE_H_
+
+/*
+ * Subsystem-private VM defs.
+ *
+ * This file is to be used only by the VM system: the files in kern/vm
+ * and the MIPS TLB code in arch/mips/vm/tlb.c. Everything else uses
+ * <vm.h> and <addrspace.h>.
+ */
+
+#include <spinlock.h>
+#include <vm.h>
+#include <pagetable.h>
+
+struct addrspace;
+struct lock;
+struct vnode;
+
+/*
+ * With page tables the stack needn't be small: any page of the 8M
+ * below USERSTACK is zero-filled the first time it is touched, and
+ * mappings go below that.
+ */
+#define VM_STACKPAGES	2048
+#define VM_STACKBASE	(USERSTACK - VM_STACKPAGES * PAGE_SIZE)
+
+#define VM_MAXCPUS	32		/* as many as CPU_MASKBIT allows */
+
+/*
+ * mm_lock protects everything pageable: page tables, memory objects,
+ * and the pageable entries of the coremap. It is held while pages are
+ * written out to swap, but not while files are read or written. (In
+ * vm.c.)
+ */
+extern struct lock *mm_lock;
+
+
+/*
+ * Coremap (coremap.c): one entry per physical page left over after
+ * boot. A page that can be paged out also records who has it mapped
+ * where, so the page-out code can find the page entry that points to
+ * it. The pageable fields are protected by coremap_lock.
+ */
+struct coremap_entry {
+	unsigned cme_used:1;
+	unsigned cme_pageable:1;	/* user page that may be paged out */
+	unsigned cme_ref:1;		/* used since the clock hand went by */
+	unsigned cme_clean:1;		/* same as its copy in cme_slot */
+	unsigned cme_onfree:1;		/* on coremap_freelist */
+	unsigned cme_npages:27;		/* run length, on a run's first page */
+	unsigned cme_nextfree;		/* next on coremap_freelist */
+	struct addrspace *cme_as;	/* owner, if pageable */
+	vaddr_t cme_vaddr;		/* where the owner has it */
+	unsigned cme_slot;		/* swap copy, if clean */
+	unsigned cme_lastuse;		/* tick it was last seen in use */
+};
+
+extern struct coremap_entry *coremap;
+extern unsigned coremap_npages;
+extern paddr_t coremap_base;		/* physical address of coremap[0] */
+extern struct spinlock coremap_lock;
+extern paddr_t zero_page;		/* all zeros; never written */
+
+/*
+ * Functions in coremap.c:
+ *    coremap_bootstrap - set up the coremap in the RAM left after boot,
+ *                  and start the pagezero thread.
+ *    getppages   - allocate NPAGES contiguous frames. 0 if there
+ *                  aren't any; user memory should use getuserpages.
+ *    free_ppages - free a run of frames from getppages.
+ *    getzeropage - a frame of zeros. Caller holds mm_lock.
+ *    coremap_avail - frames that can be had without paging.
+ *    coremap_entry - the entry for frame PADDR.
+ */
+void coremap_bootstrap(void);
+paddr_t getppages(unsigned long npages);
+void free_ppages(paddr_t paddr);
+paddr_t getzeropage(void);
+unsigned coremap_avail(void);
+struct coremap_entry *coremap_entry(paddr_t paddr);
+
+
+/*
+ * Functions in paging.c. The page_ functions and vm_loadcontrol need
+ * mm_lock.
+ *    paging_bootstrap - set up load control.
+ *    page_setowner - make frame PADDR pageable, as page VADDR of AS. If
+ *                  CLEAN, it was just read from swap slot SLOT.
+ *    page_use    - note a fault on resident pageable frame PADDR; clears
+ *                  *WRITEABLE if the page should stay read-only.
+ *    page_swapin - read page VADDR of AS, whose entry is *PE, back in.
+ *    page_discard - throw away a pageable page and clear its entry.
+ *    page_copy   - copy the page whose entry is *FROM into a new frame
+ *                  for page VADDR of AS, for fork.
+ *    getuserpages - allocate frames for user memory, paging something
+ *                  out if need be. Takes mm_lock if not held.
+ *    vm_pagein   - count a page brought in for the current process.
+ *    vm_loadcontrol - suspend AS for a while if memory is overcommitted
+ *                  and it is the process chosen to make way.
+ *    vm_loadwakeup - there may be room for a suspended process.
+ *    as_faultrate - pages brought in per second by AS, lately.
+ *    as_wscount  - pages of AS in its working set.
+ *    paging_printstats - report on page-out and load control.
+ */
+void paging_bootstrap(void);
+void page_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr,
+		   bool clean, unsigned slot);
+void page_use(paddr_t paddr, int faulttype, bool *writeable);
+int page_swapin(struct addrspace *as, vaddr_t vaddr, pte_t *pe);
+void page_discard(pte_t *pe);
+int page_copy(const pte_t *from, struct addrspace *as, vaddr_t vaddr,
+	      pte_t *ret);
+paddr_t getuserpages(unsigned long npages);
+void vm_pagein(bool major);
+void vm_loadcontrol(struct addrspace *as);
+void vm_loadwakeup(void);
+unsigned as_faultrate(struct addrspace *as, unsigned now);
+unsigned as_wscount(struct addrspace *as, unsigned now);
+void paging_printstats(void);
+
+
+/*
+ * TLB (arch/mips/vm/tlb.c): the hardware TLB, each cpu's software TLB,
+ * and shootdowns. A batch of pages to be shot down from other cpus'
+ * TLBs is kept in a shootbatch.
+ */
+struct shootbatch {
+	struct tlbshootdown sb_maps[TLBSHOOTDOWN_MAX];
+	unsigned sb_n;
+	uint32_t sb_cpus;		/* cpus that need some of them */
+};
+
+/*
+ * Functions in tlb.c:
+ *    tlb_activate - make AS the one this cpu's TLB holds.
+ *    tlb_load    - load (and cache) a TLB entry for VADDR of AS.
+ *                  Caller holds mm_lock.
+ *    tlb_unmap   - drop this cpu's TLB entries for START..END-1.
+ *    tlb_printstats - report on the software TLB and shootdowns.
+ *    swtlb_refill - try to handle a TLB miss from this cpu's cache.
+ *    swtlb_flush - drop all of AS's cached translations. Caller holds
+ *                  mm_lock.
+ *    shoot_init  - start an empty batch.
+ *    shoot_page  - take page VADDR of AS out of every TLB and cache:
+ *                  this cpu's now, others' when the batch is sent.
+ *                  Caller holds mm_lock.
+ *    shoot_flush - send the batch, and wait for it to be done.
+ */
+void tlb_activate(struct addrspace *as);
+void tlb_load(struct addrspace *as, vaddr_t vaddr, paddr_t paddr,
+	      bool writeable);
+void tlb_unmap(vaddr_t start, vaddr_t end);
+void tlb_printstats(void);
+bool swtlb_refill(int faulttype, vaddr_t vaddr);
+void swtlb_flush(struct addrspace *as);
+void shoot_init(struct shootbatch *sb);
+void shoot_page(struct shootbatch *sb, struct addrspace *as, vaddr_t vaddr);
+void shoot_flush(struct shootbatch *sb);
+
+
+/*
+ * Demand loading and text (text.c). Each region of a program remembers
+ * which part of the executable it was defined from, in a segload, and
+ * a page is read in (or zeroed) the first time it is touched. A
+ * read-only region has a textseg, which holds a frame for each page
+ * once it's been read in and may be shared with other processes
+ * running the same executable.
+ */
+struct segload {
+	struct vnode *sl_vnode;		/* executable, or NULL */
+	off_t sl_offset;		/* file offset of segment */
+	vaddr_t sl_vaddr;		/* where the segment starts */
+	size_t sl_filesz;		/* bytes of it that are in the file */
+};
+
+struct textseg {
+	vaddr_t ts_vbase;
+	size_t ts_npages;
+	paddr_t *ts_pages;		/* frame of each page, or 0 */
+	struct segload ts_load;
+	bool ts_listed;			/* on textsegs, for sharing */
+	unsigned ts_refcount;
+	struct textseg *ts_next;
+};
+
+/*
+ * Functions in text.c:
+ *    segload_create, segload_destroy, segload_copy - the usual.
+ *    segload_page - fill in page VADDR, frame PADDR, of a segment.
+ *    segload_zeroonly - whether page VADDR of a segment starts out as
+ *                  all zeros.
+ *    text_bootstrap - set up text sharing.
+ *    text_create - a textseg of NPAGES pages at VBASE, not yet shared.
+ *    text_attach - set *TEXT to the text of this region of V, if some
+ *                  other process has it.
+ *    text_publish - offer a loaded textseg to later loaders.
+ *    text_ref, text_release - take or drop a reference.
+ *    text_page   - find or read in text page VADDR.
+ *    text_count  - pages of text in memory, for reports.
+ */
+struct segload *segload_create(void);
+void segload_destroy(struct segload *sl);
+struct segload *segload_copy(struct segload *old);
+int segload_page(struct segload *sl, vaddr_t vaddr, paddr_t paddr);
+bool segload_zeroonly(struct segload *sl, vaddr_t vaddr);
+void text_bootstrap(void);
+struct textseg *text_create(vaddr_t vbase, size_t npages);
+void text_attach(struct vnode *v, vaddr_t vbase, size_t npages,
+		 struct textseg **text);
+void text_publish(struct textseg *ts);
+void text_ref(struct textseg *ts);
+void text_release(struct textseg *ts);
+int text_page(struct textseg *ts, vaddr_t vaddr, paddr_t *ret);
+unsigned text_count(struct textseg *ts);
+
+
+/*
+ * mmap (mmap.c). A mapping (struct mmregion) is a run of pages in an
+ * address space backed by part of a memory object (struct mmobj).
+ */
+struct mmobj {
+	struct vnode *mo_vnode;		/* file, or NULL if anonymous */
+	off_t mo_offset;		/* file offset of page 0 */
+	bool mo_shared;			/* changes seen by other mappings */
+	unsigned mo_refcount;		/* mappings using this */
+	unsigned mo_npages;		/* length of mo_pages */
+	pte_t *mo_pages;		/* length mo_npages */
+	struct mmregion *mo_maps;	/* mappings of this */
+	struct mmobj *mo_next;		/* on mmobjs */
+};
+
+struct mmregion {
+	vaddr_t mr_vbase;
+	unsigned mr_npages;
+	int mr_prot;			/* PROT_* */
+	struct mmobj *mr_obj;
+	unsigned mr_objpage;		/* page of mr_obj at mr_vbase */
+	struct addrspace *mr_as;	/* whose mapping this is */
+	struct mmregion *mr_next;	/* next lower mapping */
+	struct mmregion *mr_objnext;	/* next on mr_obj's mo_maps */
+};
+
+/*
+ * Functions in mmap.c (besides as_mmap, as_munmap and mmap_fsync):
+ *    mmap_find   - the mapping of AS containing VADDR, or NULL.
+ *    mmap_floor  - the lowest address used by mappings.
+ *    mmap_fault  - handle a fault on page VADDR of mapping MR.
+ *    mmap_destroy - drop all of AS's mappings.
+ *    mmap_copy   - copy OLD's mappings into NEW, for fork.
+ */
+struct mmregion *mmap_find(struct addrspace *as, vaddr_t vaddr);
+vaddr_t mmap_floor(struct addrspace *as);
+int mmap_fault(struct addrspace *as, struct mmregion *mr, int faulttype,
+	       vaddr_t vaddr);
+void mmap_destroy(struct addrspace *as);
+int mmap_copy(struct addrspace *old, struct addrspace *new);
+
+
+/*
+ * All address spaces, for load control and reports, and as_fault, in
+ * addrspace.c. as_all_lock also protects ASIDs.
+ */
+extern struct addrspace *as_all;
+extern struct spinlock as_all_lock;
+
+int as_fault(struct addrspace *as, int faulttype, vaddr_t vaddr);
+
+
+#endif /* _VMPRIVATE_H_ */
@@ -36,6 +36,7 @@
 
 
 struct wchan; /* Opaque */
+struct thread;
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -71,6 +72,13 @@ void wchan_unlock(struct wchan *wc);
  */
 void wchan_sleep(struct wchan *wc);
 
+/*
+ * Like wchan_sleep, but give up after TICKS hardclock ticks (HZ per
+ * second). Returns 0 if awakened and ETIMEDOUT if the time ran out.
+ * Either way the channel has been unlocked upon return.
+ */
+int wchan_sleep_timeout(struct wchan *wc, unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The queue should not already be locked.
@@ -81,5 +89,12 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up thread T if it is sleeping on WC. Returns false if it
+ * wasn't (it had been woken already). The queue should not already be
+ * locked.
+ */
+bool wchan_wakethread(struct wchan *wc, struct thread *t);
+
 
 #endif /* _WCHAN_H_ */
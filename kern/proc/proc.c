@@ -49,8 +49,11 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <openfile.h>
 #include <kern/fcntl.h> 
 #include <kern/limits.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
@@ -72,89 +75,274 @@ struct semaphore *no_proc_sem;
 
 #ifdef OPT_A2
 
-static struct proc_holder task_manager[MAX_PROCS];
+/*
+ * Process table.
+ *
+ * Each process has a proc_holder, which outlives it until its parent
+ * collects the exit status with waitpid. Holders are found by pid
+ * through a hash table, and pids are allocated from a bitmap. The
+ * search for a free pid starts after the last one handed out, so
+ * pids are not reused until the space wraps around and, as long as
+ * most of it is free, the search ends almost immediately.
+ *
+ * Each holder also keeps a list of its children, live and exited.
+ * When a process exits, its exited children are freed and its live
+ * ones are orphaned; an orphan (or a process started from the menu,
+ * which has no parent) frees its own holder when it exits, since no
+ * one will wait for it.
+ *
+ * pid_lock protects the hash chains and the bitmap. proc_tree_lock
+ * protects the family links and exit status, and parents waiting for
+ * a child to exit sleep on proc_wait_cv. There is one cv for
+ * everybody rather than one per process; exits are rare enough next
+ * to everything else a process does that waking every waiting parent
+ * to look at its own children costs less than creating and
+ * destroying a cv for every process.
+ */
+#define PID_HASHSIZE 128
+#define PID_HASH(pid) ((unsigned)(pid) % PID_HASHSIZE)
+#define PID_MAPWORDS (__PID_MAX / 32 + 1)
+
+static struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+static struct proc_holder *pid_hash[PID_HASHSIZE];
+static uint32_t pid_map[PID_MAPWORDS];
+static pid_t pid_next = __PID_MIN;
+static struct lock *proc_tree_lock;
+static struct cv *proc_wait_cv;
+
+// Finds and marks the next available pid; -1 if there are none.
+// Caller holds pid_lock.
+static
+pid_t
+genPID(void)
+{
+	pid_t pid = pid_next;
+	unsigned scanned = 0;
+	uint32_t bit;
 
-// Finds the next available pid
-int genPID() {
-	int newpid = __PID_MIN;
-	while(newpid <= __PID_MAX) {
-		for(int i = 0; i < MAX_PROCS; i++) {
-			if(task_manager[i].pid == newpid &&
-			   task_manager[i].in_use)
-				newpid++;
+	while (scanned <= __PID_MAX - __PID_MIN) {
+		if (pid > __PID_MAX) {
+			pid = __PID_MIN;
+		}
+		if (pid_map[pid / 32] == 0xffffffff) {
+			// whole word in use; skip to the next one
+			scanned += 32 - pid % 32;
+			pid += 32 - pid % 32;
+			continue;
+		}
+		bit = (uint32_t)1 << (pid % 32);
+		if ((pid_map[pid / 32] & bit) == 0) {
+			pid_map[pid / 32] |= bit;
+			pid_next = pid + 1;
+			return pid;
 		}
-		return newpid;
+		pid++;
+		scanned++;
 	}
-	if(newpid + 1 == __PID_MAX) 
-		panic("No more available pids");
-	return -1; // should never get here
+	return -1;
 }
 
-// Prints task_manager for debugging purposes:
+// Prints the process table for debugging purposes:
 void print_task_manager() {
-	for(int i = 0; i < MAX_PROCS; i++) {
-		if(task_manager[i].in_use) {
-			kprintf("index %d, pid %d, parent_pid %d\n",i,task_manager[i].pid,
-			        task_manager[i].parent_pid);
-}}}
-
-// returns index of PID if in task_manager; -1 otherwise
-int findPID(int pid) {
-	for(int i = 0; i < MAX_PROCS; i++) {
-		if(task_manager[i].pid == pid)
-		   return i;
+	struct proc_holder *ph;
+
+	spinlock_acquire(&pid_lock);
+	for(int i = 0; i < PID_HASHSIZE; i++) {
+		for(ph = pid_hash[i]; ph != NULL; ph = ph->next) {
+			kprintf("pid %d, parent_pid %d%s\n", ph->pid,
+			        ph->parent == NULL ? -1 : ph->parent->pid,
+			        ph->exited ? " (exited)" : "");
+		}
 	}
-	return -1;
+	spinlock_release(&pid_lock);
 }
 
-// fills in the empty struct, returns its index in the array
-int make_proc_holder(struct proc *p) {
-	int index;
-	for(index=0; index < MAX_PROCS; index++) {
-		if(!task_manager[index].in_use) {
-			task_manager[index].pid = p->pid;
-			task_manager[index].in_use = true;
-			task_manager[index].exitcode = -1;
-			if(task_manager[index].sem != NULL) {
-			// Cleans up sem if reusing the array spot
-				sem_destroy(task_manager[index].sem);
-				task_manager[index].sem = NULL;
-			}
-			task_manager[index].sem = sem_create("proc sem",0);
-			task_manager[index].p = p;
-			return index; 
-		}
+// returns the holder for PID, or NULL if there is none
+struct proc_holder *findPID(pid_t pid) {
+	struct proc_holder *ph;
+
+	spinlock_acquire(&pid_lock);
+	for(ph = pid_hash[PID_HASH(pid)]; ph != NULL; ph = ph->next) {
+		if(ph->pid == pid)
+			break;
 	}
-	panic("No more available proc spots");
-	return -1; // should never get here
+	spinlock_release(&pid_lock);
+	return ph;
 }
 
-// Helper functions to access or change ph fields
-int get_ph_parent_pid(int index) {
-	return task_manager[index].parent_pid;
+// allocates a holder and a pid for P; NULL if out of either
+struct proc_holder *make_proc_holder(struct proc *p) {
+	struct proc_holder *ph;
+
+	ph = kmalloc(sizeof(*ph));
+	if(ph == NULL)
+		return NULL;
+	ph->exitcode = -1;
+	ph->exited = false;
+	ph->p = p;
+	ph->parent = NULL;
+	ph->children = NULL;
+	ph->sibling = NULL;
+
+	spinlock_acquire(&pid_lock);
+	ph->pid = genPID();
+	if(ph->pid < 0) {
+		spinlock_release(&pid_lock);
+		kfree(ph);
+		return NULL;
+	}
+	ph->next = pid_hash[PID_HASH(ph->pid)];
+	pid_hash[PID_HASH(ph->pid)] = ph;
+	spinlock_release(&pid_lock);
+
+	return ph;
 }
-void set_ph_parent_pid(int index, int parent_pid) {
-	task_manager[index].parent_pid = parent_pid;
-	return;
+
+// takes CHILD off its parent's list; caller holds proc_tree_lock
+static void unlink_child(struct proc_holder *child) {
+	struct proc_holder **pp;
+
+	KASSERT(child->parent != NULL);
+	for(pp = &child->parent->children; *pp != child; pp = &(*pp)->sibling) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = child->sibling;
+	child->parent = NULL;
+	child->sibling = NULL;
 }
-void set_ph_not_in_use(int index) {
-	task_manager[index].in_use = false;
-	return;
+
+// gives back the holder and its pid; caller holds proc_tree_lock
+static void release_holder(struct proc_holder *ph) {
+	struct proc_holder **pp;
+
+	KASSERT(ph->parent == NULL && ph->children == NULL);
+	spinlock_acquire(&pid_lock);
+	for(pp = &pid_hash[PID_HASH(ph->pid)]; *pp != ph; pp = &(*pp)->next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = ph->next;
+	pid_map[ph->pid / 32] &= ~((uint32_t)1 << (ph->pid % 32));
+	spinlock_release(&pid_lock);
+
+	kfree(ph);
 }
-int get_ph_exitcode(int index) {
-	return task_manager[index].exitcode;
+
+// releases the holder of a process that never ran (failed fork)
+void free_proc_holder(struct proc_holder *ph) {
+	lock_acquire(proc_tree_lock);
+	KASSERT(ph->children == NULL);
+	if(ph->parent != NULL)
+		unlink_child(ph);
+	release_holder(ph);
+	lock_release(proc_tree_lock);
 }
-void set_ph_exitcode(int index, int exitcode) {
-	task_manager[index].exitcode = exitcode;
-	return;
+
+// makes CHILD a child of PARENT
+void proc_addchild(struct proc *parent, struct proc *child) {
+	struct proc_holder *ph = parent->holder;
+	struct proc_holder *ch = child->holder;
+
+	lock_acquire(proc_tree_lock);
+	KASSERT(ch->parent == NULL);
+	ch->parent = ph;
+	ch->sibling = ph->children;
+	ph->children = ch;
+	lock_release(proc_tree_lock);
 }
-void p_ph_sem(int index) {
-	P(task_manager[index].sem);
-	return;
+
+// records the exit of the process with holder PH, whose resource
+// usage (including its children's) is USAGE
+void proc_holder_exit(struct proc_holder *ph, int waitstatus,
+		      const struct thread_usage *usage) {
+	struct proc_holder *child, *next;
+
+	lock_acquire(proc_tree_lock);
+	ph->exitcode = waitstatus;
+	ph->exited = true;
+	ph->p = NULL;
+
+	// the parent is charged for us
+	if(ph->parent != NULL && ph->parent->p != NULL)
+		thread_usage_add(&ph->parent->p->p_childusage, usage);
+
+	// reap the children that have exited and orphan the rest
+	for(child = ph->children; child != NULL; child = next) {
+		next = child->sibling;
+		child->parent = NULL;
+		child->sibling = NULL;
+		if(child->exited)
+			release_holder(child);
+	}
+	ph->children = NULL;
+
+	if(ph->parent == NULL) {
+		// nobody will wait for us
+		release_holder(ph);
+	}
+	else {
+		cv_broadcast(proc_wait_cv, proc_tree_lock);
+	}
+	lock_release(proc_tree_lock);
 }
-void v_ph_sem(int index) {
-	V(task_manager[index].sem);
-	return;
+
+// the usage of P's exited children
+void proc_childusage(struct proc *p, struct thread_usage *ret) {
+	lock_acquire(proc_tree_lock);
+	*ret = p->p_childusage;
+	lock_release(proc_tree_lock);
+}
+
+/*
+ * Wait for a child of PARENT to exit and collect its status: the child
+ * with pid PID, or any child if PID is -1. With WNOHANG, return right
+ * away with *RETPID = 0 if there is no exited child yet.
+ */
+int proc_holder_wait(struct proc_holder *parent, pid_t pid, int options,
+		     int *status, pid_t *retpid) {
+	struct proc_holder *ph;
+
+	lock_acquire(proc_tree_lock);
+	while(1) {
+		if(pid == -1) {
+			if(parent->children == NULL) {
+				lock_release(proc_tree_lock);
+				return ECHILD;
+			}
+			for(ph = parent->children; ph != NULL; ph = ph->sibling) {
+				if(ph->exited)
+					break;
+			}
+		}
+		else {
+			// the holder can't be freed while we hold the tree lock
+			ph = findPID(pid);
+			if(ph == NULL) {
+				lock_release(proc_tree_lock);
+				return ESRCH;
+			}
+			if(ph->parent != parent) {
+				lock_release(proc_tree_lock);
+				return ECHILD;
+			}
+			if(!ph->exited)
+				ph = NULL;
+		}
+
+		if(ph != NULL) {
+			*status = ph->exitcode;
+			*retpid = ph->pid;
+			unlink_child(ph);
+			release_holder(ph);
+			lock_release(proc_tree_lock);
+			return 0;
+		}
+		if(options & WNOHANG) {
+			*retpid = 0;
+			lock_release(proc_tree_lock);
+			return 0;
+		}
+		cv_wait(proc_wait_cv, proc_tree_lock);
+	}
 }
 	
 #endif /* OPT_A2 */ 
@@ -193,7 +381,13 @@ proc_create(const char *name)
 
 #ifdef OPT_A2
 	proc->pid = 1; // special PID for kern
-//	proc->index = make_proc_holder(proc);
+	proc->holder = NULL;
+	proc->p_vforksem = NULL;
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_childusage, sizeof(proc->p_childusage));
+	for (int i = 0; i < OPEN_MAX; i++) {
+		proc->p_fds[i] = NULL;
+	}
 #endif /* OPT_A2 */
 	return proc;
 }
@@ -248,6 +442,10 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
+#ifdef OPT_A2
+	fdtable_closeall(proc);
+#endif /* OPT_A2 */
+
 #ifdef UW
 	if (proc->console) {
 	  vfs_close(proc->console);
@@ -282,18 +480,6 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
-#ifdef OPT_A2
-	// Initialize task_manager
-	for(int i = 0; i < MAX_PROCS; i++) {
-		task_manager[i].pid = -1;
-		task_manager[i].parent_pid = -1;
-		task_manager[i].in_use = false;
-		task_manager[i].exitcode = -1;
-		task_manager[i].sem = NULL;
-		task_manager[i].p = NULL;
-	}
-#endif // OPT_A2
-
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
@@ -309,6 +495,16 @@ proc_bootstrap(void)
     panic("could not create no_proc_sem semaphore\n");
   }
 #endif // UW 
+#ifdef OPT_A2
+  proc_tree_lock = lock_create("proc_tree_lock");
+  if (proc_tree_lock == NULL) {
+    panic("could not create proc_tree_lock\n");
+  }
+  proc_wait_cv = cv_create("proc_wait_cv");
+  if (proc_wait_cv == NULL) {
+    panic("could not create proc_wait_cv\n");
+  }
+#endif /* OPT_A2 */
 }
 
 /*
@@ -321,14 +517,20 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
+#ifdef OPT_A2
+	/*
+	 * The console is opened as fds 0-2 by runprogram; fork copies
+	 * the parent's descriptors instead.
+	 */
+#elif defined(UW)
+	char *console_path;
+
 	/* open the console - this should always succeed */
 	console_path = kstrdup("con:");
 	if (console_path == NULL) {
@@ -373,10 +575,13 @@ proc_create_runprogram(const char *name)
 #endif // UW
 
 #ifdef OPT_A2
-	// Take an available PID for proc
-	proc->pid = genPID();
-	// Add to task_manager and set index
-	proc->index = make_proc_holder(proc);
+	// Take an available PID for proc and enter it in the process table
+	proc->holder = make_proc_holder(proc);
+	if (proc->holder == NULL) {
+		proc_destroy(proc);
+		return NULL;
+	}
+	proc->pid = proc->holder->pid;
 #endif /* OPT_A2 */
 	return proc;
 }
@@ -421,6 +626,9 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+#ifdef OPT_A2
+			thread_usage_add(&proc->p_usage, &t->t_usage);
+#endif
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
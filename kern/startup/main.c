@@ -49,6 +49,9 @@
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <argbuf.h>
+#include <uw-vmstats.h>
+#include "opt-A3.h"
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -124,6 +127,9 @@ boot(void)
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
+#ifdef OPT_A2
+	argbuf_bootstrap();
+#endif
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -146,6 +152,10 @@ shutdown(void)
 {
 
 	kprintf("Shutting down.\n");
+#if OPT_A3
+	vmstats_print();
+	vm_printstats();
+#endif
 	
 	vfs_clearbootfs();
 	vfs_clearcurdir();
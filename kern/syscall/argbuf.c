@@ -0,0 +1,232 @@
+/*
+ * Program argument staging. See argbuf.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <argbuf.h>
+#include "opt-A2.h"
+#include "opt-A3.h"
+
+#ifdef OPT_A2
+
+/* Number of user argv pointers fetched per copyin. */
+#define ARGBUF_CHUNK 32
+
+struct argbuf {
+	char *ab_buf;		/* ARG_MAX bytes */
+	size_t ab_len;		/* Bytes of strings (with NULs) gathered */
+	int ab_argc;		/* Number of strings gathered */
+#if !OPT_A3
+	struct lock *ab_lock;
+#endif
+};
+
+#if !OPT_A3
+static uint64_t argbuf_space[ARG_MAX / sizeof(uint64_t)];
+static struct argbuf the_argbuf;
+#endif
+
+/*
+ * Space left for the string of argument ARGNUM, given the strings
+ * gathered so far: whatever leaves room for at least ARGNUM+2 argv
+ * slots (the ones so far, this one, and the NULL) after the strings
+ * are padded out to pointer alignment.
+ */
+static
+size_t
+argbuf_room(struct argbuf *ab, int argnum)
+{
+	size_t used;
+
+	used = ROUNDUP(ab->ab_len, sizeof(userptr_t)) +
+		(argnum + 2) * sizeof(userptr_t);
+	if (used >= ARG_MAX) {
+		return 0;
+	}
+	return ARG_MAX - used;
+}
+
+#if OPT_A3
+
+void
+argbuf_bootstrap(void)
+{
+	/* nothing to do: each exec has a buffer of its own */
+}
+
+struct argbuf *
+argbuf_create(void)
+{
+	struct argbuf *ab;
+
+	ab = kmalloc(sizeof(*ab));
+	if (ab == NULL) {
+		return NULL;
+	}
+	ab->ab_buf = kmalloc(ARG_MAX);
+	if (ab->ab_buf == NULL) {
+		kfree(ab);
+		return NULL;
+	}
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+	return ab;
+}
+
+void
+argbuf_destroy(struct argbuf *ab)
+{
+	kfree(ab->ab_buf);
+	kfree(ab);
+}
+
+#else /* !OPT_A3 */
+
+void
+argbuf_bootstrap(void)
+{
+	the_argbuf.ab_buf = (char *)argbuf_space;
+	the_argbuf.ab_len = 0;
+	the_argbuf.ab_argc = 0;
+	the_argbuf.ab_lock = lock_create("argbuf");
+	if (the_argbuf.ab_lock == NULL) {
+		panic("argbuf_bootstrap: out of memory\n");
+	}
+}
+
+struct argbuf *
+argbuf_create(void)
+{
+	lock_acquire(the_argbuf.ab_lock);
+	the_argbuf.ab_len = 0;
+	the_argbuf.ab_argc = 0;
+	return &the_argbuf;
+}
+
+void
+argbuf_destroy(struct argbuf *ab)
+{
+	KASSERT(ab == &the_argbuf);
+	lock_release(ab->ab_lock);
+}
+
+#endif /* OPT_A3 */
+
+int
+argbuf_copyin(struct argbuf *ab, userptr_t uargv)
+{
+	userptr_t chunk[ARGBUF_CHUNK];
+	vaddr_t addr;
+	size_t room, got;
+	unsigned i, n;
+	int result;
+
+	addr = (vaddr_t)uargv;
+	if (addr % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+
+	while (1) {
+		/*
+		 * Fetch a batch of pointers, but not past the end of
+		 * the page the next one is on: for all we know the
+		 * array ends on that page and the next is unmapped.
+		 */
+		n = (PAGE_SIZE - addr % PAGE_SIZE) / sizeof(userptr_t);
+		if (n > ARGBUF_CHUNK) {
+			n = ARGBUF_CHUNK;
+		}
+		result = copyin((const_userptr_t)addr, chunk,
+				n * sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
+
+		for (i=0; i<n; i++) {
+			if (chunk[i] == NULL) {
+				return 0;
+			}
+			room = argbuf_room(ab, ab->ab_argc);
+			if (room == 0) {
+				return E2BIG;
+			}
+			result = copyinstr(chunk[i], ab->ab_buf + ab->ab_len,
+					   room, &got);
+			if (result == ENAMETOOLONG) {
+				return E2BIG;
+			}
+			if (result) {
+				return result;
+			}
+			ab->ab_len += got;
+			ab->ab_argc++;
+		}
+		addr += n * sizeof(userptr_t);
+	}
+}
+
+int
+argbuf_load(struct argbuf *ab, char **args, int argc)
+{
+	size_t len;
+	int i;
+
+	for (i=0; i<argc; i++) {
+		len = strlen(args[i]) + 1;
+		if (len > argbuf_room(ab, ab->ab_argc)) {
+			return E2BIG;
+		}
+		memcpy(ab->ab_buf + ab->ab_len, args[i], len);
+		ab->ab_len += len;
+		ab->ab_argc++;
+	}
+	return 0;
+}
+
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr,
+	       userptr_t *uargv, int *argc)
+{
+	size_t strsize, size;
+	userptr_t *argv;
+	vaddr_t base;
+	char *s;
+	int i, result;
+
+	/*
+	 * Lay out the block: strings, padding, argv[0..argc]. The
+	 * block goes at the top of the stack, and the stack pointer
+	 * ends up at its (8-byte aligned) bottom.
+	 */
+	strsize = ROUNDUP(ab->ab_len, sizeof(userptr_t));
+	size = strsize + (ab->ab_argc + 1) * sizeof(userptr_t);
+	KASSERT(size <= ARG_MAX);
+	base = (*stackptr - size) & ~(vaddr_t)7;
+
+	bzero(ab->ab_buf + ab->ab_len, strsize - ab->ab_len);
+	argv = (userptr_t *)(ab->ab_buf + strsize);
+	s = ab->ab_buf;
+	for (i=0; i<ab->ab_argc; i++) {
+		argv[i] = (userptr_t)(base + (s - ab->ab_buf));
+		s += strlen(s) + 1;
+	}
+	argv[ab->ab_argc] = NULL;
+
+	result = copyout(ab->ab_buf, (userptr_t)base, size);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = base;
+	*uargv = (userptr_t)(base + strsize);
+	*argc = ab->ab_argc;
+	return 0;
+}
+
+#endif /* OPT_A2 */
@@ -8,6 +8,459 @@
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include "opt-A2.h"
+#include "opt-A3.h"
+#ifdef OPT_A2
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
+#include <limits.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <openfile.h>
+#endif /* OPT_A2 */
+
+#ifdef OPT_A2
+
+/* Largest transfer whose size we can return. */
+#define RW_MAXLEN 0x7fffffff
+
+/* Up to this many iovecs are copied in on the stack rather than kmalloc'd. */
+#define RW_SMALLIOV 8
+
+#if OPT_A3
+/*
+ * Touch each page of the user buffers before handing them to the file
+ * system. A program page is read in from its executable the first
+ * time it is touched, and if that happened in the middle of the
+ * uiomove in VOP_READ or VOP_WRITE it could need the very device lock
+ * the file system is holding (emufs holds its lock across uiomove).
+ */
+static
+int
+file_prefault(struct iovec *iov, unsigned iovcnt)
+{
+	vaddr_t va, end;
+	unsigned i;
+	char c;
+	int result;
+
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len == 0) {
+			continue;
+		}
+		va = (vaddr_t)iov[i].iov_ubase;
+		end = va + iov[i].iov_len;
+		while (va < end) {
+			result = copyin((const_userptr_t)va, &c, 1);
+			if (result) {
+				return result;
+			}
+			va = (va & PAGE_FRAME) + PAGE_SIZE;
+		}
+	}
+	return 0;
+}
+#endif
+
+/*
+ * Charge a transfer of LEN bytes to the current thread.
+ */
+static
+void
+file_account(enum uio_rw rw, size_t len)
+{
+	struct thread_usage *tu = &curthread->t_usage;
+
+	if (rw == UIO_READ) {
+		tu->tu_inblock++;
+		tu->tu_inbytes += len;
+	}
+	else {
+		tu->tu_oublock++;
+		tu->tu_outbytes += len;
+	}
+}
+
+/*
+ * Read or write the user buffers in IOV (IOVCNT of them, LEN bytes in
+ * all) on FD, all with a single VOP_READ or VOP_WRITE.
+ *
+ * If USEPOS is false, the transfer happens at the file's seek position,
+ * which it then advances. The openfile's lock is held throughout, so
+ * the I/O and the offset update are atomic with respect to other users
+ * of the same openfile (including other processes, after fork).
+ *
+ * If USEPOS is true (pread and friends), the transfer happens at POS
+ * and the seek position is neither used nor changed, so the lock isn't
+ * needed and concurrent positional I/O on one openfile doesn't
+ * serialize here.
+ */
+static
+int
+file_rw(int fd, struct iovec *iov, unsigned iovcnt, size_t len,
+	off_t pos, bool usepos, enum uio_rw rw, int *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	struct uio u;
+	int accmode, result;
+
+	result = fd_get(curproc, fd, &of);
+	if (result) {
+		return result;
+	}
+	accmode = of->of_flags & O_ACCMODE;
+	if (rw == UIO_READ ? accmode == O_WRONLY : accmode == O_RDONLY) {
+		return EBADF;
+	}
+
+#if OPT_A3
+	result = file_prefault(iov, iovcnt);
+	if (result) {
+		return result;
+	}
+#endif
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_resid = len;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = rw;
+	u.uio_space = curproc->p_addrspace;
+
+	if (usepos) {
+		if (pos < 0) {
+			return EINVAL;
+		}
+		/* fails with ESPIPE on the console */
+		result = VOP_TRYSEEK(of->of_vnode, pos);
+		if (result) {
+			return result;
+		}
+		u.uio_offset = pos;
+		if (rw == UIO_READ) {
+			result = VOP_READ(of->of_vnode, &u);
+		}
+		else {
+			result = VOP_WRITE(of->of_vnode, &u);
+		}
+		if (result) {
+			return result;
+		}
+		*retval = len - u.uio_resid;
+		file_account(rw, *retval);
+		return 0;
+	}
+
+	lock_acquire(of->of_lock);
+	if (rw == UIO_WRITE && (of->of_flags & O_APPEND)) {
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_lock);
+			return result;
+		}
+		of->of_offset = st.st_size;
+	}
+	u.uio_offset = of->of_offset;
+	if (rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, &u);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, &u);
+	}
+	if (!result) {
+		of->of_offset = u.uio_offset;
+	}
+	lock_release(of->of_lock);
+	if (result) {
+		return result;
+	}
+
+	/* pass back the number of bytes actually transferred */
+	*retval = len - u.uio_resid;
+	KASSERT(*retval >= 0);
+	file_account(rw, *retval);
+	return 0;
+}
+
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+	struct openfile *of;
+	char *path;
+	int result, fd;
+
+	DEBUG(DB_SYSCALL,"Syscall: open(%x,%d)\n",(unsigned int)upath,flags);
+
+	path = kmalloc(PATH_MAX);
+	if (path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(upath, path, PATH_MAX, NULL);
+	if (result) {
+		kfree(path);
+		return result;
+	}
+
+	/* vfs_open destroys the path; we don't need it afterwards anyway */
+	result = openfile_open(path, flags, mode, &of);
+	kfree(path);
+	if (result) {
+		return result;
+	}
+
+	result = fd_alloc(curproc, of, &fd);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	*retval = fd;
+	return 0;
+}
+
+int
+sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+	struct iovec iov;
+
+	DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+	iov.iov_ubase = ubuf;
+	iov.iov_len = nbytes;
+	return file_rw(fdesc, &iov, 1, nbytes, 0, false, UIO_READ, retval);
+}
+
+int
+sys_write(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+	struct iovec iov;
+
+	DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+	iov.iov_ubase = ubuf;
+	iov.iov_len = nbytes;
+	return file_rw(fdesc, &iov, 1, nbytes, 0, false, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	  int *retval)
+{
+	struct iovec iov;
+
+	DEBUG(DB_SYSCALL,"Syscall: pread(%d,%x,%d,%lld)\n",fdesc,(unsigned int)ubuf,nbytes,pos);
+
+	iov.iov_ubase = ubuf;
+	iov.iov_len = nbytes;
+	return file_rw(fdesc, &iov, 1, nbytes, pos, true, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+	   int *retval)
+{
+	struct iovec iov;
+
+	DEBUG(DB_SYSCALL,"Syscall: pwrite(%d,%x,%d,%lld)\n",fdesc,(unsigned int)ubuf,nbytes,pos);
+
+	iov.iov_ubase = ubuf;
+	iov.iov_len = nbytes;
+	return file_rw(fdesc, &iov, 1, nbytes, pos, true, UIO_WRITE, retval);
+}
+
+/*
+ * Common code for the vectored calls: copy in the user's iovec array
+ * (on the stack if it's short) in one go, total it up, and do the whole
+ * thing as one transfer.
+ */
+static
+int
+file_rwv(int fd, userptr_t uiov, int iovcnt, off_t pos, bool usepos,
+	 enum uio_rw rw, int *retval)
+{
+	struct iovec smalliov[RW_SMALLIOV];
+	struct iovec *iov;
+	size_t len;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	if (iovcnt <= RW_SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto done;
+	}
+
+	len = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > RW_MAXLEN - len) {
+			result = EINVAL;
+			goto done;
+		}
+		len += iov[i].iov_len;
+	}
+
+	result = file_rw(fd, iov, iovcnt, len, pos, usepos, rw, retval);
+
+ done:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+int
+sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+	DEBUG(DB_SYSCALL,"Syscall: readv(%d,%x,%d)\n",fdesc,(unsigned int)iov,iovcnt);
+
+	return file_rwv(fdesc, iov, iovcnt, 0, false, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+	DEBUG(DB_SYSCALL,"Syscall: writev(%d,%x,%d)\n",fdesc,(unsigned int)iov,iovcnt);
+
+	return file_rwv(fdesc, iov, iovcnt, 0, false, UIO_WRITE, retval);
+}
+
+int
+sys_preadv(int fdesc, userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	DEBUG(DB_SYSCALL,"Syscall: preadv(%d,%x,%d,%lld)\n",fdesc,(unsigned int)iov,iovcnt,pos);
+
+	return file_rwv(fdesc, iov, iovcnt, pos, true, UIO_READ, retval);
+}
+
+int
+sys_pwritev(int fdesc, userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	DEBUG(DB_SYSCALL,"Syscall: pwritev(%d,%x,%d,%lld)\n",fdesc,(unsigned int)iov,iovcnt,pos);
+
+	return file_rwv(fdesc, iov, iovcnt, pos, true, UIO_WRITE, retval);
+}
+
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	off_t newpos;
+	int result;
+
+	DEBUG(DB_SYSCALL,"Syscall: lseek(%d,%lld,%d)\n",fdesc,pos,whence);
+
+	result = fd_get(curproc, fdesc, &of);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(of->of_lock);
+	switch (whence) {
+	    case SEEK_SET:
+		newpos = pos;
+		break;
+	    case SEEK_CUR:
+		newpos = of->of_offset + pos;
+		break;
+	    case SEEK_END:
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_lock);
+			return result;
+		}
+		newpos = st.st_size + pos;
+		break;
+	    default:
+		lock_release(of->of_lock);
+		return EINVAL;
+	}
+	if (newpos < 0) {
+		lock_release(of->of_lock);
+		return EINVAL;
+	}
+	/* this is what rejects seeks on the console */
+	result = VOP_TRYSEEK(of->of_vnode, newpos);
+	if (result) {
+		lock_release(of->of_lock);
+		return result;
+	}
+	of->of_offset = newpos;
+	lock_release(of->of_lock);
+
+	*retval = newpos;
+	return 0;
+}
+
+int
+sys_close(int fdesc)
+{
+	DEBUG(DB_SYSCALL,"Syscall: close(%d)\n",fdesc);
+
+	return fd_close(curproc, fdesc);
+}
+
+#if OPT_A3
+int
+sys_fsync(int fdesc)
+{
+	struct openfile *of;
+	int result;
+
+	DEBUG(DB_SYSCALL,"Syscall: fsync(%d)\n",fdesc);
+
+	result = fd_get(curproc, fdesc, &of);
+	if (result) {
+		return result;
+	}
+	/* Changes made through mappings go to the file first. */
+	mmap_fsync(of->of_vnode);
+	return VOP_FSYNC(of->of_vnode);
+}
+#endif
+
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+	struct openfile *of;
+	int result;
+
+	DEBUG(DB_SYSCALL,"Syscall: dup2(%d,%d)\n",oldfd,newfd);
+
+	result = fd_get(curproc, oldfd, &of);
+	if (result) {
+		return result;
+	}
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	if (newfd != oldfd) {
+		openfile_incref(of);
+		if (curproc->p_fds[newfd] != NULL) {
+			fd_close(curproc, newfd);
+		}
+		curproc->p_fds[newfd] = of;
+	}
+	*retval = newfd;
+	return 0;
+}
+
+#else
 
 /* handler for write() system call                  */
 /*
@@ -58,3 +511,5 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+
+#endif /* OPT_A2 */
@@ -74,6 +74,7 @@
  * change this code to not use uiomove, be sure to check for this case
  * explicitly.
  */
+#if !OPT_A3
 static
 int
 load_segment(struct addrspace *as, struct vnode *v,
@@ -144,6 +145,7 @@ load_segment(struct addrspace *as, struct vnode *v,
 	
 	return result;
 }
+#endif
 
 /*
  * Load an ELF executable user program into the current address space.
@@ -253,6 +255,11 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		}
 	}
 
+#if OPT_A3
+	/* Map in text segments some other process has already loaded. */
+	as_share_text(as, v);
+#endif
+
 	result = as_prepare_load(as);
 	if (result) {
 		return result;
@@ -288,9 +295,15 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+#if OPT_A3
+		/* Pages are read in as they are touched; see vm_fault. */
+		result = as_define_file(as, v, ph.p_offset, ph.p_vaddr,
+					ph.p_memsz, ph.p_filesz);
+#else
 		result = load_segment(as, v, ph.p_offset, ph.p_vaddr, 
 				      ph.p_memsz, ph.p_filesz,
 				      ph.p_flags & PF_X);
+#endif
 		if (result) {
 			return result;
 		}
@@ -0,0 +1,183 @@
+/*
+ * Open files and per-process file descriptor tables.
+ * See openfile.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/unistd.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <proc.h>
+#include <openfile.h>
+#include "opt-A2.h"
+
+#ifdef OPT_A2
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	int result;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, flags, mode, &of->of_vnode);
+	if (result) {
+		lock_destroy(of->of_lock);
+		kfree(of);
+		return result;
+	}
+
+	of->of_flags = flags & (O_ACCMODE | O_APPEND);
+	of->of_offset = 0;
+	of->of_refcount = 1;
+	spinlock_init(&of->of_reflock);
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_reflock);
+
+	if (last) {
+		vfs_close(of->of_vnode);
+		lock_destroy(of->of_lock);
+		spinlock_cleanup(&of->of_reflock);
+		kfree(of);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+int
+fd_get(struct proc *p, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || p->p_fds[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = p->p_fds[fd];
+	return 0;
+}
+
+int
+fd_alloc(struct proc *p, struct openfile *of, int *fd)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (p->p_fds[i] == NULL) {
+			p->p_fds[i] = of;
+			*fd = i;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+int
+fd_close(struct proc *p, int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = fd_get(p, fd, &of);
+	if (result) {
+		return result;
+	}
+	p->p_fds[fd] = NULL;
+	openfile_decref(of);
+	return 0;
+}
+
+void
+fdtable_copy(struct proc *from, struct proc *to)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		KASSERT(to->p_fds[i] == NULL);
+		if (from->p_fds[i] != NULL) {
+			openfile_incref(from->p_fds[i]);
+			to->p_fds[i] = from->p_fds[i];
+		}
+	}
+}
+
+void
+fdtable_closeall(struct proc *p)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (p->p_fds[i] != NULL) {
+			openfile_decref(p->p_fds[i]);
+			p->p_fds[i] = NULL;
+		}
+	}
+}
+
+int
+fdtable_stdio(struct proc *p)
+{
+	struct openfile *of;
+	char path[5];
+	int result;
+
+	KASSERT(p->p_fds[STDIN_FILENO] == NULL);
+	KASSERT(p->p_fds[STDOUT_FILENO] == NULL);
+	KASSERT(p->p_fds[STDERR_FILENO] == NULL);
+
+	/* vfs_open may destroy the path, so use a fresh copy each time */
+	strcpy(path, "con:");
+	result = openfile_open(path, O_RDONLY, 0, &of);
+	if (result) {
+		return result;
+	}
+	p->p_fds[STDIN_FILENO] = of;
+
+	strcpy(path, "con:");
+	result = openfile_open(path, O_WRONLY, 0, &of);
+	if (result) {
+		fdtable_closeall(p);
+		return result;
+	}
+	p->p_fds[STDOUT_FILENO] = of;
+
+	/* stderr shares stdout's openfile */
+	openfile_incref(of);
+	p->p_fds[STDERR_FILENO] = of;
+
+	return 0;
+}
+
+#endif /* OPT_A2 */
@@ -15,29 +15,77 @@
 #include <vfs.h>
 #include <kern/fcntl.h>
 #include <limits.h>
+#include <openfile.h>
+#include <argbuf.h>
+#include <clock.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
 
-void sys__exit(int exitcode) {
-
-  struct addrspace *as;
-  struct proc *p = curproc;
 #ifdef OPT_A2
-	if(findPID(p->pid) == -1) 
-		panic("Could not find exiting process in array");
-	set_ph_exitcode(p->index,_MKWAIT_EXIT(exitcode));
-	// for waitpid
-	v_ph_sem(p->index);
-#else
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-  (void)exitcode;
+/*
+ * A vforked child is done with its parent's address space, because it
+ * has exec'd or is exiting: let go of it, without destroying it, and
+ * let the parent run again.
+ */
+static
+void
+vfork_release(void)
+{
+	struct proc *p = curproc;
+	struct semaphore *sem = p->p_vforksem;
+
+	KASSERT(sem != NULL);
+	as_deactivate();
+	curproc_setas(NULL);
+	p->p_vforksem = NULL;
+	V(sem);
+}
+
+/*
+ * Hand WAITSTATUS, and our resource usage and our children's, to
+ * whoever waits for us.
+ */
+static
+void
+proc_exit_report(struct proc *p, int waitstatus)
+{
+	struct proc_holder *ph = p->holder;
+	struct thread_usage usage, childusage;
+
+	if(ph == NULL || findPID(p->pid) != ph)
+		panic("Could not find exiting process in process table");
+	// our usage so far, for the parent
+	spinlock_acquire(&p->p_lock);
+	usage = p->p_usage;
+	spinlock_release(&p->p_lock);
+	thread_usage_add(&usage, &curthread->t_usage);
+	proc_childusage(p, &childusage);
+	thread_usage_add(&usage, &childusage);
+	// for waitpid (and this may free the holder)
+	proc_holder_exit(ph, waitstatus, &usage);
+	p->holder = NULL;
+}
 #endif /* OPT_A2 */
 
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+/*
+ * Get rid of the exiting process's address space.
+ */
+static
+void
+proc_exit_as(void)
+{
+  struct addrspace *as;
 
-  KASSERT(curproc->p_addrspace != NULL);
+#ifdef OPT_A2
+  if (curproc->p_vforksem != NULL) {
+	/* the address space is our parent's; just give it back */
+	vfork_release();
+	return;
+  }
+#endif /* OPT_A2 */
   as_deactivate();
   /*
    * clear p_addrspace before calling as_destroy. Otherwise if
@@ -48,6 +96,27 @@ void sys__exit(int exitcode) {
    */
   as = curproc_setas(NULL);
   as_destroy(as);
+}
+
+void sys__exit(int exitcode) {
+  proc_exit(_MKWAIT_EXIT(exitcode));
+}
+
+/*
+ * Exit the current process with wait status WAITSTATUS: for _exit,
+ * or when the process is killed by a fatal trap.
+ */
+void proc_exit(int waitstatus) {
+  struct proc *p = curproc;
+
+#ifdef OPT_A2
+  proc_exit_report(p, waitstatus);
+#endif /* OPT_A2 */
+
+  DEBUG(DB_SYSCALL,"Syscall: _exit, wait status 0x%x\n",waitstatus);
+
+  KASSERT(curproc->p_addrspace != NULL);
+  proc_exit_as();
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -85,26 +154,35 @@ sys_waitpid(pid_t pid,
 {
   int exitstatus;
   int result;
-  if (options != 0) {
-    return(EINVAL);
-  }
 #ifdef OPT_A2
-	int pid_index = findPID(pid);
-	//If pid is not in task_manager
-	if(pid_index == -1) {
-		return (ESRCH);
+	if (options & ~WNOHANG) {
+		return(EINVAL);
+	}
+	// No process groups: only a specific pid, or -1 for any child
+	if (pid != -1 && pid <= 0) {
+		return(EINVAL);
+	}
+	result = proc_holder_wait(curproc->holder, pid, options,
+				  &exitstatus, retval);
+	if (result) {
+		return(result);
+	}
+	if (*retval == 0) {
+		// WNOHANG, and nobody has exited yet
+		return(0);
 	}
-	//If curproc doesn't own pid
-	if(curproc->pid != get_ph_parent_pid(pid_index)) {
-		return(ECHILD);
+	// status may be NULL if the caller doesn't want it
+	if (status != NULL) {
+		result = copyout((void *)&exitstatus,status,sizeof(int));
+		if (result) {
+			return(result);
+		}
 	}
-	//Wait for child to exit
-	p_ph_sem(pid_index);
-	//Get exitcode
-	exitstatus = get_ph_exitcode(pid_index);
-	//Can now reuse
-	set_ph_not_in_use(pid_index);
+	return(0);
 #else
+  if (options != 0) {
+    return(EINVAL);
+  }
   /* this is just a stub implementation that always reports an
      exit status of 0, regardless of the actual exit status of
      the specified process.   
@@ -132,7 +210,10 @@ sys_fork(struct trapframe *tf,
 	// create child proc & set parent pid
 	struct proc *child = proc_create_runprogram("child_proc");
 	if(child == NULL) return ENOMEM;
-	set_ph_parent_pid(child->index,curproc->pid);
+	proc_addchild(curproc, child);
+
+	// share the parent's open files
+	fdtable_copy(curproc, child);
 
 	// "copies A's trap frame to the new thread's kernel stack
     struct trapframe *child_tf = kmalloc(sizeof(struct trapframe));
@@ -154,150 +235,185 @@ sys_fork(struct trapframe *tf,
 	return 0;
 }
 
+/*
+ * Like fork, but the child runs in the parent's address space (and on
+ * its stack) instead of a copy, and the parent sleeps until the child
+ * execs or exits. For the usual fork-then-exec this skips copying an
+ * address space only to throw it away. The child must do nothing but
+ * exec or _exit.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct proc *child;
+	struct trapframe *child_tf;
+	struct semaphore *sem;
+	pid_t pid;
+	int error;
+
+	sem = sem_create("vfork", 0);
+	if (sem == NULL) {
+		return ENOMEM;
+	}
+	child_tf = kmalloc(sizeof(struct trapframe));
+	if (child_tf == NULL) {
+		sem_destroy(sem);
+		return ENOMEM;
+	}
+	memcpy(child_tf, tf, sizeof(struct trapframe));
+
+	child = proc_create_runprogram("child_proc");
+	if (child == NULL) {
+		kfree(child_tf);
+		sem_destroy(sem);
+		return ENOMEM;
+	}
+	proc_addchild(curproc, child);
+	fdtable_copy(curproc, child);
+
+	// lend the child our address space
+	child->p_addrspace = curproc_getas();
+	child->p_vforksem = sem;
+	pid = child->pid;
+
+	error = thread_fork("child_thread", child,
+			    enter_forked_process, child_tf,
+			    (unsigned long)&(child->p_addrspace));
+	if (error) {
+		child->p_addrspace = NULL;
+		child->p_vforksem = NULL;
+		free_proc_holder(child->holder);
+		proc_destroy(child);
+		kfree(child_tf);
+		sem_destroy(sem);
+		return error;
+	}
+
+	// wait for it back (the child may be gone by the time we wake)
+	P(sem);
+	sem_destroy(sem);
+	as_activate();
+
+	*retval = pid;
+	return 0;
+}
+
+/*
+ * Put things back the way they were after a failed exec.
+ */
+static
+int
+execv_fail(struct addrspace *oldas, struct argbuf *ab, int result)
+{
+	struct addrspace *as;
+
+	as = curproc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+	argbuf_destroy(ab);
+	return result;
+}
+
 int sys_execv( char *program, char **args, pid_t *retval) {
 
 	// Most of this code is copied from runprogram:
-    struct addrspace *as;
+    struct addrspace *as, *oldas;
     struct vnode *v;
     vaddr_t entrypoint, stackptr;
+    struct argbuf *ab;
+    userptr_t uargv;
+    int argc;
     int result;
 
 // Step 1: Copy arguments from user space into kernel buffer
-	// Copy name
-	int name_length = 0;
-	while(program[name_length] != '\0')
-		name_length++;
-	name_length++; // for '\0'
-	char* name = kmalloc(name_length*sizeof(char));
+	// Copy name (don't touch the user's string except through copyinstr)
+	char* name = kmalloc(PATH_MAX);
 	if(name == NULL) {
 		return ENOMEM;
 	}
-	result = copyinstr((const_userptr_t)program,name,name_length,NULL);
+	result = copyinstr((const_userptr_t)program,name,PATH_MAX,NULL);
 	if(result) {
+		kfree(name);
 		return result;
 	}
 
-	// Count Arguments
-	int argc = 0;
-	while(args[argc] != NULL) {
-		argc++;
+	// Copy args into the staging buffer. It stays ours until the
+	// args are on the new stack.
+	ab = argbuf_create();
+	if (ab == NULL) {
+		kfree(name);
+		return ENOMEM;
 	}
-	
-	// Copy Args
-	int total_length = 0; // for error checking purposes
-	char *buffer[argc+1];
-	for(int i=0; i < argc; i++) {
-		// Find length of arg[i]
-		int length = 0;
-		while(args[i][length] != '\0')
-			length++;
-		length++; // for '\0'
-		// Find offset if needed 
-		int offset = 0;
-		while((length+offset)%4 != 0)
-			offset++;
-		total_length += length;
-		// Copy arg
-		buffer[i] = kmalloc((length+offset)*sizeof(char));
-		if(buffer[i] == NULL) {
-			return ENOMEM;
-		}
-		result = copyinstr((const_userptr_t)args[i],buffer[i],length,NULL);
-		if(result) {
-			return result;
-		}
+	result = argbuf_copyin(ab, (userptr_t)args);
+	if(result) {
+		argbuf_destroy(ab);
+		kfree(name);
+		return result;
 	}
-	
-	if(total_length > ARG_MAX)
-		return E2BIG;
-
-	// Last argument is NULL
-	buffer[argc]=NULL;
 
 // Step 2: Open executable, create new as, load elf
 	/* Open the file. */
 	result = vfs_open(name, O_RDONLY, 0, &v);
+	kfree(name);
 	if (result) {
+		argbuf_destroy(ab);
 		return result;
 	}
 
-	as_destroy(curproc->p_addrspace);
-	curproc_setas(NULL);
-    /* We should be a new process. */
-    KASSERT(curproc_getas() == NULL);
-
     /* Create a new address space. */
     as = as_create();
     if (as ==NULL) {
         vfs_close(v);
+        argbuf_destroy(ab);
         return ENOMEM;
     }
 
-    /* Switch to it and activate it. */
-    curproc_setas(as);
+    /*
+     * Switch to it and activate it. Keep the old one until the new
+     * one is ready, so that a failed exec can return to the caller.
+     */
+    oldas = curproc_setas(as);
     as_activate();
 
     /* Load the executable. */
     result = load_elf(v, &entrypoint);
-    if (result) {
-        /* p_addrspace will go away when curproc is destroyed */
-        vfs_close(v);
-        return result;
-    }
 
     /* Done with the file now. */
     vfs_close(v);
 
+    if (result) {
+        return execv_fail(oldas, ab, result);
+    }
+
     /* Define the user stack in the address space */
     result = as_define_stack(as, &stackptr);
     if (result) {
-        /* p_addrspace will go away when curproc is destroyed */
-        return result;
+        return execv_fail(oldas, ab, result);
     }
 
 // Step 3: Copy the arguments from kernel buffer into user stack
-    size_t kargv[argc+1];
-
-    // Copyouts each arg & stores address
-    for(int i = 0; i < argc; i++) {
-		// Find length of arg from end to front of array
-        int length = 0;
-        while(buffer[argc-i-1][length] != '\0')
-            length++;
-        length++; // for '\0'
-		// Allocate room for arg
-        stackptr -= length;
-		// Add offset if needed
-        while(stackptr % 4 != 0) {
-            stackptr--;
-        }
-        copyoutstr(buffer[argc-i-1],(userptr_t)stackptr,length,NULL);
-		// Store address of arg
-        kargv[argc-i-1] = stackptr;
-    }
-    kargv[argc] = 0; // For NULL
-    // Copyouts kargv[]
-    for(int i = 0; i < argc+1; i++) {
-		// sizeof(char *) is 4 so can hardcode in
-        stackptr -= 4;
-        copyout((char*)&kargv[argc-i],(userptr_t)stackptr,4);
-    }
-	// Kargvptr = where kargv starts
-    size_t kargvptr = stackptr;
-    // Ensure stackptr is multiple of 8
-    while(stackptr % 8 != 0) {
-        stackptr--;
-    }
+	// strings and argv[] go out in one copyout
+	result = argbuf_copyout(ab, &stackptr, &uargv, &argc);
+	if (result) {
+		return execv_fail(oldas, ab, result);
+	}
+	argbuf_destroy(ab);
 
-	// Cleanup before ending
-	kfree(name);
-	for(int i = 0; i < argc; i++) {	
-		kfree(buffer[i]);
+	// Get rid of the old image (or give it back, if it was lent to
+	// us by vfork)
+	if (curproc->p_vforksem != NULL) {
+		struct semaphore *sem = curproc->p_vforksem;
+
+		curproc->p_vforksem = NULL;
+		V(sem);
+	}
+	else {
+		as_destroy(oldas);
 	}
 
 // Step 4: Return to user mode using enter_new_process
     /* Warp to user mode. */
-    enter_new_process(argc, (userptr_t) kargvptr,
+    enter_new_process(argc, uargv,
               stackptr, entrypoint);
 
     /* enter_new_process does not return. */
@@ -306,4 +422,56 @@ int sys_execv( char *program, char **args, pid_t *retval) {
 	return EINVAL;
 
 }
+
+/*
+ * Resource usage of the calling process or its exited children. CPU
+ * time is sampled: each hardclock tick is charged, in user or system
+ * time, to whichever thread it interrupted.
+ */
+int
+sys_getrusage(int who, userptr_t uusage)
+{
+	struct thread_usage tu;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		spinlock_acquire(&curproc->p_lock);
+		tu = curproc->p_usage;
+		spinlock_release(&curproc->p_lock);
+		thread_usage_add(&tu, &curthread->t_usage);
+		break;
+	    case RUSAGE_CHILDREN:
+		proc_childusage(curproc, &tu);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ru.ru_utime.tv_sec = tu.tu_uticks / HZ;
+	ru.ru_utime.tv_usec = (tu.tu_uticks % HZ) * (1000000 / HZ);
+	ru.ru_stime.tv_sec = tu.tu_sticks / HZ;
+	ru.ru_stime.tv_usec = (tu.tu_sticks % HZ) * (1000000 / HZ);
+	ru.ru_minflt = tu.tu_minflt;
+	ru.ru_majflt = tu.tu_majflt;
+	ru.ru_inblock = tu.tu_inblock;
+	ru.ru_oublock = tu.tu_oublock;
+	ru.ru_nvcsw = tu.tu_nvcsw;
+	ru.ru_nivcsw = tu.tu_nivcsw;
+	ru.ru_inbytes = tu.tu_inbytes;
+	ru.ru_outbytes = tu.tu_outbytes;
+
+	return copyout(&ru, uusage, sizeof(ru));
+}
+
+/*
+ * Pin the calling process (its one thread) to a set of cpus. Children
+ * forked afterwards inherit the mask.
+ */
+int
+sys_setaffinity(unsigned int cpumask)
+{
+	return thread_setaffinity(cpumask);
+}
 #endif //OPT_A2
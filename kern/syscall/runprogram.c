@@ -45,6 +45,8 @@
 #include <syscall.h>
 #include <test.h>
 #include <copyinout.h>
+#include <openfile.h>
+#include <argbuf.h>
 #include "opt-A2.h"
 
 /*
@@ -61,14 +63,33 @@ int runprogram(char *program, char **args, int argc) {
     struct addrspace *as;
     struct vnode *v;
     vaddr_t entrypoint, stackptr;
+    struct argbuf *ab;
+    userptr_t uargv;
     int result;
 
-// Step 1: Not needed in runprogram: this is kern->userspace
+// Step 1: Stage the (kernel) args
+    ab = argbuf_create();
+    if (ab == NULL) {
+        return ENOMEM;
+    }
+    result = argbuf_load(ab, args, argc);
+    if (result) {
+        argbuf_destroy(ab);
+        return result;
+    }
+
+    /* Attach the console as stdin, stdout, and stderr. */
+    result = fdtable_stdio(curproc);
+    if (result) {
+        argbuf_destroy(ab);
+        return result;
+    }
 
 // Step 2: Open executable, create new as, load elf
     /* Open the file. */
     result = vfs_open(program, O_RDONLY, 0, &v);
     if (result) {
+        argbuf_destroy(ab);
         return result;
     }
 
@@ -79,6 +100,7 @@ int runprogram(char *program, char **args, int argc) {
     as = as_create();
     if (as ==NULL) {
         vfs_close(v);
+        argbuf_destroy(ab);
         return ENOMEM;
     }
 
@@ -91,6 +113,7 @@ int runprogram(char *program, char **args, int argc) {
     if (result) {
         /* p_addrspace will go away when curproc is destroyed */
         vfs_close(v);
+        argbuf_destroy(ab);
         return result;
     }
 
@@ -101,44 +124,19 @@ int runprogram(char *program, char **args, int argc) {
     result = as_define_stack(as, &stackptr);
     if (result) {
         /* p_addrspace will go away when curproc is destroyed */
+        argbuf_destroy(ab);
         return result;
     }
 
 // Step 3: Copy the arguments from kernel buffer into user stack
-	size_t kargv[argc+1];
-	// Copyouts each arg & stores address
-	for(int i = 0; i < argc; i++) {
-		// Find length of arg from back to front
-		int length = 0;
-		while(args[argc-i-1][length] != '\0')
-			length++;
-		length++; // for '\0'
-		// Make room for arg
-		stackptr -= length;
-		// Make room for offset
-		while(stackptr % 4 != 0) {
-			stackptr--;
-		}
-		copyoutstr(args[argc-i-1],(userptr_t)stackptr,length,NULL);
-		// Store address of arg
-		kargv[argc-i-1] = stackptr; 
-	}
-	kargv[argc] = 0; // For NULL
-	// Copyouts kargv[]
-	for(int i = 0; i < argc+1; i++) {
-		// sizeof(*char) = 4, can hard code
-		stackptr -= 4;
-		copyout((char*)&kargv[argc-i],(userptr_t)stackptr,4);
-	}
-	// kargvptr is &kargv
-	size_t kargvptr = stackptr;
-	// Ensure stackptr is multiple of 8
-	while(stackptr % 8 != 0) {
-		stackptr--;
-	}
+    result = argbuf_copyout(ab, &stackptr, &uargv, &argc);
+    argbuf_destroy(ab);
+    if (result) {
+        return result;
+    }
 
     /* Warp to user mode. */
-    enter_new_process(argc,(userptr_t) kargvptr,
+    enter_new_process(argc, uargv,
               stackptr, entrypoint);
     
     /* enter_new_process does not return. */
@@ -0,0 +1,104 @@
+/*
+ * Memory management system calls.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <current.h>
+#include <proc.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <openfile.h>
+#include <syscall.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * Move the break by AMOUNT bytes and return the old one.
+ */
+int
+sys_sbrk(intptr_t amount, vaddr_t *retval)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+	return as_sbrk(as, amount, retval);
+}
+
+/*
+ * Map LEN bytes of file FD starting at OFFSET, or anonymous zeroed
+ * memory if MAP_ANON is given.
+ */
+int
+sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, vaddr_t *retval)
+{
+	struct addrspace *as;
+	struct openfile *of;
+	struct vnode *v;
+	int sharing, result;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+
+	sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+	if (sharing != MAP_SHARED && sharing != MAP_PRIVATE) {
+		return EINVAL;
+	}
+	if (len == 0 || offset < 0 || (offset & ~(off_t)PAGE_FRAME) != 0) {
+		return EINVAL;
+	}
+	if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) {
+		return EINVAL;
+	}
+
+	v = NULL;
+	if ((flags & MAP_ANON) == 0) {
+		result = fd_get(curproc, fd, &of);
+		if (result) {
+			return result;
+		}
+		if ((of->of_flags & O_ACCMODE) == O_WRONLY) {
+			return EACCES;
+		}
+		if (sharing == MAP_SHARED && (prot & PROT_WRITE) &&
+		    (of->of_flags & O_ACCMODE) != O_RDWR) {
+			return EACCES;
+		}
+		v = of->of_vnode;
+		result = VOP_MMAP(v);
+		if (result) {
+			return result;
+		}
+	}
+	else {
+		offset = 0;
+	}
+
+	return as_mmap(as, addr, len, prot, flags, v, offset, retval);
+}
+
+/*
+ * Remove any mappings in ADDR..ADDR+LEN.
+ */
+int
+sys_munmap(vaddr_t addr, size_t len)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+	return as_munmap(as, addr, len);
+}
+
+#endif /* OPT_A3 */
@@ -32,9 +32,11 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <current.h>
 #include <synch.h>
 #include <test.h>
 
@@ -347,3 +349,305 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+//
+// Priority inversion test.
+//
+// A low-priority thread takes a lock and then has some work to do
+// while holding it. Some medium-priority hogs then start spinning,
+// and a high-priority thread tries to get the lock. Without priority
+// inheritance the hogs keep the low thread (and therefore the high
+// thread) off the cpu until they give up; with it, the low thread is
+// boosted past the hogs and the high thread waits only about as long
+// as the low thread's critical section.
+
+#define PI_NHOGS      4
+#define PI_HOLDMSECS  100	/* low thread's time in the critical section */
+#define PI_HOGSECS    3		/* how long the hogs spin */
+
+static struct lock *pilock;
+static struct semaphore *piholding;
+static struct semaphore *pidone;
+static volatile uint32_t pi_waitsecs, pi_waitnsecs;
+
+/* Spin (without blocking) for the given wall-clock time. */
+static
+void
+pi_spin(time_t secs, uint32_t nsecs)
+{
+	time_t s0, s1, ds;
+	uint32_t ns0, ns1, dns;
+
+	gettime(&s0, &ns0);
+	do {
+		gettime(&s1, &ns1);
+		getinterval(s0, ns0, s1, ns1, &ds, &dns);
+	} while (ds < secs || (ds == secs && dns < nsecs));
+}
+
+static
+void
+pi_lowthread(void *junk, unsigned long unused)
+{
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_MIN + 1);
+	lock_acquire(pilock);
+	V(piholding);
+	pi_spin(0, PI_HOLDMSECS * 1000000);
+	lock_release(pilock);
+	V(pidone);
+}
+
+static
+void
+pi_hogthread(void *junk, unsigned long unused)
+{
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_DEFAULT);
+	pi_spin(PI_HOGSECS, 0);
+	V(pidone);
+}
+
+static
+void
+pi_highthread(void *junk, unsigned long unused)
+{
+	time_t s0, s1, ds;
+	uint32_t ns0, ns1, dns;
+
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_MAX - 1);
+	gettime(&s0, &ns0);
+	lock_acquire(pilock);
+	gettime(&s1, &ns1);
+	lock_release(pilock);
+
+	getinterval(s0, ns0, s1, ns1, &ds, &dns);
+	pi_waitsecs = ds;
+	pi_waitnsecs = dns;
+	V(pidone);
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int i, result, oldpri;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting priority inversion test...\n");
+
+	pilock = lock_create("pilock");
+	piholding = sem_create("piholding", 0);
+	pidone = sem_create("pidone", 0);
+	if (pilock == NULL || piholding == NULL || pidone == NULL) {
+		panic("pitest: out of memory\n");
+	}
+
+	/* Run above everything we create so we can set things up. */
+	oldpri = curthread->t_basepri;
+	thread_setpriority(PRI_MAX);
+
+	result = thread_fork("pi_low", NULL, pi_lowthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(piholding);
+
+	for (i=0; i<PI_NHOGS; i++) {
+		result = thread_fork("pi_hog", NULL, pi_hogthread, NULL, i);
+		if (result) {
+			panic("pitest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("pi_high", NULL, pi_highthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	/* Get out of the way and wait for everyone. */
+	thread_setpriority(oldpri);
+	for (i=0; i<PI_NHOGS + 2; i++) {
+		P(pidone);
+	}
+
+	kprintf("High-priority thread waited %lu.%09lu seconds "
+		"(hogs ran for %d)\n", (unsigned long)pi_waitsecs,
+		(unsigned long)pi_waitnsecs, PI_HOGSECS);
+	if (pi_waitsecs * 2 < (uint32_t)PI_HOGSECS) {
+		kprintf("TEST SUCCEEDED\n");
+	}
+	else {
+		kprintf("TEST FAILED\n");
+	}
+
+	sem_destroy(pidone);
+	sem_destroy(piholding);
+	lock_destroy(pilock);
+	kprintf("Priority inversion test done\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timed wait test.
+//
+// Checks that P_timed and cv_timedwait time out when nobody wakes
+// them, return early when somebody does, and that a batch of timers
+// with deadlines on both sides of the wheel's first level all fire
+// in order.
+
+#define TW_NTHREADS   12
+
+static struct semaphore *twsem;
+static struct semaphore *twdone;
+static struct lock *twlock;
+static struct cv *twcv;
+static volatile unsigned tw_order;
+static volatile bool tw_failed;
+
+static
+unsigned
+tw_elapsed_msecs(time_t s0, uint32_t ns0)
+{
+	time_t s1, ds;
+	uint32_t ns1, dns;
+
+	gettime(&s1, &ns1);
+	getinterval(s0, ns0, s1, ns1, &ds, &dns);
+	return ds * 1000 + dns / 1000000;
+}
+
+static
+void
+tw_poster(void *junk, unsigned long ticks)
+{
+	(void)junk;
+
+	while (ticks-- > 0) {
+		thread_yield();
+	}
+	V(twsem);
+}
+
+/* Each of these waits a different length of time; they should finish
+   in the order of their numbers. */
+static
+void
+tw_sleeper(void *junk, unsigned long num)
+{
+	struct semaphore *never;
+	unsigned ticks;
+
+	(void)junk;
+
+	never = sem_create("tw_never", 0);
+	if (never == NULL) {
+		panic("twtest: sem_create failed\n");
+	}
+
+	/* 8, 16, ... ticks: the later ones start out in level 1. */
+	ticks = (num + 1) * 8;
+	if (P_timed(never, ticks) != ETIMEDOUT) {
+		kprintf("twtest: thread %lu: P_timed did not time out\n", num);
+		tw_failed = true;
+	}
+
+	lock_acquire(twlock);
+	if (tw_order != num) {
+		kprintf("twtest: thread %lu finished %uth\n", num, tw_order);
+		tw_failed = true;
+	}
+	tw_order++;
+	lock_release(twlock);
+
+	sem_destroy(never);
+	V(twdone);
+}
+
+int
+twtest(int nargs, char **args)
+{
+	time_t s0;
+	uint32_t ns0;
+	unsigned ms;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting timed wait test...\n");
+
+	twsem = sem_create("twsem", 0);
+	twdone = sem_create("twdone", 0);
+	twlock = lock_create("twlock");
+	twcv = cv_create("twcv");
+	if (twsem == NULL || twdone == NULL || twlock == NULL || twcv == NULL) {
+		panic("twtest: out of memory\n");
+	}
+	tw_failed = false;
+	tw_order = 0;
+
+	/* Nobody posts: should time out after about a quarter second. */
+	gettime(&s0, &ns0);
+	result = P_timed(twsem, HZ / 4);
+	ms = tw_elapsed_msecs(s0, ns0);
+	kprintf("P_timed with no V: %s after %u ms\n", strerror(result), ms);
+	if (result != ETIMEDOUT || ms < 200) {
+		tw_failed = true;
+	}
+
+	/* Someone posts: should return well before the deadline. */
+	result = thread_fork("tw_poster", NULL, tw_poster, NULL, 10);
+	if (result) {
+		panic("twtest: thread_fork failed: %s\n", strerror(result));
+	}
+	gettime(&s0, &ns0);
+	result = P_timed(twsem, HZ * 10);
+	ms = tw_elapsed_msecs(s0, ns0);
+	kprintf("P_timed with V: returned %d after %u ms\n", result, ms);
+	if (result != 0 || ms >= 10000) {
+		tw_failed = true;
+	}
+
+	/* Nobody signals: should time out and still hold the lock. */
+	lock_acquire(twlock);
+	result = cv_timedwait(twcv, twlock, HZ / 10);
+	if (result != ETIMEDOUT || !lock_do_i_hold(twlock)) {
+		kprintf("cv_timedwait: wrong result %d or lock lost\n", result);
+		tw_failed = true;
+	}
+	lock_release(twlock);
+
+	/* A bunch of staggered timeouts. */
+	for (i=0; i<TW_NTHREADS; i++) {
+		result = thread_fork("tw_sleeper", NULL, tw_sleeper, NULL, i);
+		if (result) {
+			panic("twtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<TW_NTHREADS; i++) {
+		P(twdone);
+	}
+
+	kprintf(tw_failed ? "TEST FAILED\n" : "TEST SUCCEEDED\n");
+
+	cv_destroy(twcv);
+	lock_destroy(twlock);
+	sem_destroy(twdone);
+	sem_destroy(twsem);
+	kprintf("Timed wait test done\n");
+
+	return 0;
+}
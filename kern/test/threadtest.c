@@ -32,6 +32,9 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -144,3 +147,212 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Affinity test. Each thread pins itself to one cpu and then spins
+ * and yields for a while, checking where it is. There are more
+ * threads than cpus, so every cpu has something else to run and a
+ * thread should be off the wrong cpu by its first yield. Once it
+ * reaches its own cpu it should never be seen anywhere else, however
+ * hard thread_consider_migration tries to even out the load.
+ */
+#define PINLOOPS  200
+
+static volatile unsigned pin_early;	/* yields before reaching our cpu */
+static volatile unsigned pin_strays;	/* seen elsewhere after arriving */
+
+static
+void
+pinthread(void *junk, unsigned long cpunum)
+{
+	uint32_t mask = (uint32_t)1 << cpunum;
+	bool arrived = false;
+	volatile int j;
+	int i, result;
+
+	(void)junk;
+
+	result = thread_setaffinity(mask);
+	if (result) {
+		panic("tt4: thread_setaffinity failed: %s\n",
+		      strerror(result));
+	}
+
+	for (i=0; i<PINLOOPS; i++) {
+		if (CPU_MASKBIT(curcpu) & mask) {
+			arrived = true;
+		}
+		else if (arrived) {
+			pin_strays++;
+		}
+		else {
+			pin_early++;
+		}
+		for (j=0; j<5000; j++);
+		thread_yield();
+	}
+
+	V(tsem);
+}
+
+/*
+ * A single CPU-bound thread that pins itself away from the cpu it's
+ * on. Nothing else is runnable there, so it has to go via the idle
+ * thread; it must be on its new cpu as soon as thread_setaffinity
+ * returns, and stay there while it spins without yielding.
+ */
+static volatile bool lone_moved;
+
+static
+void
+lonethread(void *junk, unsigned long numcpus)
+{
+	uint32_t mask;
+	volatile int j;
+	int result;
+
+	(void)junk;
+
+	mask = (uint32_t)1 << ((curcpu->c_number + 1) % numcpus);
+	result = thread_setaffinity(mask);
+	if (result) {
+		panic("tt4: thread_setaffinity failed: %s\n",
+		      strerror(result));
+	}
+	lone_moved = (CPU_MASKBIT(curcpu) & mask) != 0;
+	for (j=0; j<1000000; j++) {
+		if ((CPU_MASKBIT(curcpu) & mask) == 0) {
+			lone_moved = false;
+		}
+	}
+
+	V(tsem);
+}
+
+int
+threadtest4(int nargs, char **args)
+{
+	char name[16];
+	unsigned numcpus;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread affinity test...\n");
+
+	/* Count the cpus by finding the first one we can't pin to. */
+	for (numcpus = 0; numcpus < 32; numcpus++) {
+		if (thread_setaffinity((uint32_t)1 << numcpus)) {
+			break;
+		}
+	}
+	thread_setaffinity(CPUMASK_ALL);
+	kprintf("%u cpus\n", numcpus);
+
+	pin_early = pin_strays = 0;
+	for (i=0; i<NTHREADS; i++) {
+		snprintf(name, sizeof(name), "pinthread%d", i);
+		result = thread_fork(name, NULL, pinthread, NULL,
+				     i % numcpus);
+		if (result) {
+			panic("tt4: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(tsem);
+	}
+
+	kprintf("%u yields before threads reached their cpus, "
+		"%u strays afterwards\n", pin_early, pin_strays);
+
+	lone_moved = true;
+	if (numcpus > 1) {
+		result = thread_fork("lonethread", NULL, lonethread, NULL,
+				     numcpus);
+		if (result) {
+			panic("tt4: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		P(tsem);
+		kprintf("lone CPU-bound thread %s\n",
+			lone_moved ? "moved" : "did not move");
+	}
+
+	if (pin_strays == 0 && lone_moved) {
+		kprintf("TEST SUCCEEDED\n");
+	}
+	else {
+		kprintf("TEST FAILED\n");
+	}
+	kprintf("Thread affinity test done.\n");
+
+	return 0;
+}
+
+/*
+ * Thread creation benchmark. Forks a lot of threads that exit right
+ * away, NTHREADS at a time, and reports how long each one took from
+ * thread_fork to thread_exit. This is dominated by thread setup and
+ * teardown, so it shows whether the thread cache is doing its job.
+ */
+#define FORKBENCH_DEFAULT  2000
+
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+int
+threadtest5(int nargs, char **args)
+{
+	time_t s0, s1, ds;
+	uint32_t ns0, ns1, dns;
+	unsigned total, usecs;
+	int i, n, result;
+
+	if (nargs == 1) {
+		total = FORKBENCH_DEFAULT;
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		total = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: tt5 [nthreads]\n");
+		return 1;
+	}
+
+	init_sem();
+	kprintf("Starting thread creation benchmark...\n");
+
+	gettime(&s0, &ns0);
+	for (n=0; n<(int)total; n+=NTHREADS) {
+		for (i=0; i<NTHREADS; i++) {
+			result = thread_fork("nullthread", NULL, nullthread,
+					     NULL, 0);
+			if (result) {
+				panic("tt5: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (i=0; i<NTHREADS; i++) {
+			P(tsem);
+		}
+	}
+	gettime(&s1, &ns1);
+
+	getinterval(s0, ns0, s1, ns1, &ds, &dns);
+	usecs = ds * 1000000 + dns / 1000;
+	kprintf("%d threads in %lu.%09lu seconds (%u usec each)\n",
+		n, (unsigned long)ds, (unsigned long)dns, usecs / n);
+	kprintf("Thread creation benchmark done.\n");
+
+	return 0;
+}
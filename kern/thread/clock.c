@@ -34,13 +34,13 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <timer.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * This is pretty primitive. For callbacks at specific points in the
+ * future, with hardclock resolution, see the timer wheel in timer.c.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -92,7 +92,19 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	/* Charge the tick to whoever it interrupted. */
+	if (curthread->t_intr_user) {
+		curthread->t_usage.tu_uticks++;
+	}
+	else {
+		curthread->t_usage.tu_sticks++;
+	}
+
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		/* One cpu drives the timer wheel. */
+		timer_tick();
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
@@ -33,12 +33,14 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <timer.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -129,6 +131,41 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timed(struct semaphore *sem, unsigned ticks)
+{
+        unsigned deadline, now;
+        int result;
+
+        KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        deadline = timer_ticks() + ticks;
+
+	spinlock_acquire(&sem->sem_lock);
+        while (sem->sem_count == 0) {
+                now = timer_ticks();
+                if ((int)(deadline - now) <= 0) {
+                        spinlock_release(&sem->sem_lock);
+                        return ETIMEDOUT;
+                }
+		/* Same bridging to the wchan lock as in P. */
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+                result = wchan_sleep_timeout(sem->sem_wchan, deadline - now);
+
+		spinlock_acquire(&sem->sem_lock);
+                if (result && sem->sem_count == 0) {
+                        spinlock_release(&sem->sem_lock);
+                        return result;
+                }
+        }
+        KASSERT(sem->sem_count > 0);
+        sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+        return 0;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -147,6 +184,167 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Priority inheritance bookkeeping (t_waitlock, t_lkwaitnext, t_pri,
+ * lk_waiters) is protected by this spinlock. When both are needed it
+ * is taken before a lock's lk_lock. Walkers of lock chains are
+ * serialized by it, which is what makes taking several lk_locks
+ * hand-over-hand below safe.
+ */
+static struct spinlock lock_pi_spinlock = SPINLOCK_INITIALIZER;
+
+/*
+ * Recompute T's effective priority. T must be curthread (nobody else
+ * touches t_heldlocks) and the caller must hold lock_pi_spinlock.
+ */
+static
+void
+lock_pi_recompute_locked(struct thread *t)
+{
+        struct lock *lk;
+        struct thread *w;
+        int pri;
+
+        KASSERT(t == curthread);
+        KASSERT(spinlock_do_i_hold(&lock_pi_spinlock));
+
+        pri = t->t_basepri;
+        for (lk = t->t_heldlocks; lk != NULL; lk = lk->lk_heldnext) {
+                for (w = lk->lk_waiters; w != NULL; w = w->t_lkwaitnext) {
+                        if (w->t_pri > pri) {
+                                pri = w->t_pri;
+                        }
+                }
+        }
+        t->t_pri = pri;
+}
+
+void
+lock_pi_recompute(void)
+{
+        spinlock_acquire(&lock_pi_spinlock);
+        lock_pi_recompute_locked(curthread);
+        spinlock_release(&lock_pi_spinlock);
+}
+
+/*
+ * Lend priority PRI to the owner of LOCK, and onward along the chain
+ * of locks the owners are themselves blocked on. Stops as soon as it
+ * reaches a thread that is already at least that important, so a
+ * chain is never walked twice for the same boost.
+ *
+ * The caller holds lock_pi_spinlock and LOCK's lk_lock. A boosted
+ * thread that is sitting on a run queue gets moved up the next time
+ * schedule() runs on its cpu.
+ */
+static
+void
+lock_pi_boost(struct lock *lock, int pri)
+{
+        struct lock *cur, *next;
+        struct thread *owner;
+
+        KASSERT(spinlock_do_i_hold(&lock_pi_spinlock));
+        KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+        cur = lock;
+        owner = cur->lk_owner;
+        while (owner != NULL && owner->t_pri < pri) {
+                owner->t_pri = pri;
+                thread_priority_changed(owner);
+                next = owner->t_waitlock;
+                if (next == NULL || next == lock) {
+                        /* end of chain (or a deadlock cycle) */
+                        break;
+                }
+                spinlock_acquire(&next->lk_lock);
+                if (cur != lock) {
+                        spinlock_release(&cur->lk_lock);
+                }
+                cur = next;
+                owner = cur->lk_owner;
+        }
+        if (cur != lock) {
+                spinlock_release(&cur->lk_lock);
+        }
+}
+
+/*
+ * Slow path of lock_acquire: register as a waiter, boost the owner,
+ * and sleep until the lock is free. Returns with lk_lock held and
+ * lk_value == 1.
+ */
+static
+void
+lock_wait(struct lock *lock)
+{
+        struct thread **tp;
+        struct thread *w;
+
+        spinlock_acquire(&lock_pi_spinlock);
+        spinlock_acquire(&lock->lk_lock);
+
+        curthread->t_waitlock = lock;
+        curthread->t_lkwaitnext = lock->lk_waiters;
+        lock->lk_waiters = curthread;
+
+        while (lock->lk_value == 0) {
+                lock_pi_boost(lock, curthread->t_pri);
+                wchan_lock(lock->lk_wchan);
+                spinlock_release(&lock_pi_spinlock);
+                spinlock_release(&lock->lk_lock);
+                wchan_sleep(lock->lk_wchan);
+                spinlock_acquire(&lock_pi_spinlock);
+                spinlock_acquire(&lock->lk_lock);
+        }
+
+        /* No longer waiting; take ourselves off the waiter list */
+        for (tp = &lock->lk_waiters; *tp != curthread;
+             tp = &(*tp)->t_lkwaitnext) {
+                KASSERT(*tp != NULL);
+        }
+        *tp = curthread->t_lkwaitnext;
+        curthread->t_lkwaitnext = NULL;
+        curthread->t_waitlock = NULL;
+
+        /* We are about to own the lock: inherit from whoever's left */
+        for (w = lock->lk_waiters; w != NULL; w = w->t_lkwaitnext) {
+                if (w->t_pri > curthread->t_pri) {
+                        curthread->t_pri = w->t_pri;
+                }
+        }
+
+        spinlock_release(&lock_pi_spinlock);
+}
+
+/*
+ * Wake the most important thread waiting for LOCK (the one that has
+ * waited longest, among equals), so that the waiter a boost was for
+ * is the one that gets the lock. If it's already awake, it will take
+ * the lock without help. The caller holds lk_lock; priorities are
+ * read without lock_pi_spinlock, so a boost made meanwhile may be
+ * missed, which is harmless.
+ */
+static
+void
+lock_wakebest(struct lock *lock)
+{
+        struct thread *w, *best;
+
+        KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+        /* The list is newest first, so >= finds the oldest of equals */
+        best = NULL;
+        for (w = lock->lk_waiters; w != NULL; w = w->t_lkwaitnext) {
+                if (best == NULL || w->t_pri >= best->t_pri) {
+                        best = w;
+                }
+        }
+        if (best != NULL) {
+                wchan_wakethread(lock->lk_wchan, best);
+        }
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -175,6 +373,8 @@ lock_create(const char *name)
         // Initialize Values
         lock->lk_value = 1;
         lock->lk_owner = NULL;
+        lock->lk_heldnext = NULL;
+        lock->lk_waiters = NULL;
 
         return lock;
 }
@@ -184,6 +384,7 @@ lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
         KASSERT(lock->lk_owner == NULL);
+        KASSERT(lock->lk_waiters == NULL);
 
         spinlock_cleanup(&lock->lk_lock);
         wchan_destroy(lock->lk_wchan);
@@ -201,17 +402,17 @@ lock_acquire(struct lock *lock)
 
         spinlock_acquire(&lock->lk_lock);
 
-          // If locked, wait until unlocked
-          while(lock->lk_value == 0) {
-            wchan_lock(lock->lk_wchan);
+          // If locked, wait until unlocked (lending our priority)
+          if (lock->lk_value == 0) {
             spinlock_release(&lock->lk_lock);
-            wchan_sleep(lock->lk_wchan);
-            spinlock_acquire(&lock->lk_lock);
+            lock_wait(lock);
           }
           KASSERT(lock->lk_value == 1);
           // Acquire
           lock->lk_value = 0; 
           lock->lk_owner = curthread;
+          lock->lk_heldnext = curthread->t_heldlocks;
+          curthread->t_heldlocks = lock;
 
         spinlock_release(&lock->lk_lock);
 }
@@ -219,6 +420,9 @@ lock_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
+        struct lock **lkp;
+        bool boosted;
+
 	KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));       
  
@@ -227,11 +431,27 @@ lock_release(struct lock *lock)
           // Release
           lock->lk_value = 1;
           lock->lk_owner = NULL;
+          for (lkp = &curthread->t_heldlocks; *lkp != lock;
+               lkp = &(*lkp)->lk_heldnext) {
+                  KASSERT(*lkp != NULL);
+          }
+          *lkp = lock->lk_heldnext;
+          lock->lk_heldnext = NULL;
           KASSERT(lock->lk_value == 1);
           KASSERT(lock->lk_owner == NULL);
-          wchan_wakeone(lock->lk_wchan);
+          /*
+           * Any boost lent to us through this lock happened under
+           * lk_lock, so it is visible here.
+           */
+          boosted = (curthread->t_pri != curthread->t_basepri);
+          lock_wakebest(lock);
         
 	spinlock_release(&lock->lk_lock);
+
+        if (boosted) {
+                // Give back what was lent to us through this lock
+                lock_pi_recompute();
+        }
 }
 
 bool
@@ -302,6 +522,22 @@ cv_wait(struct cv *cv, struct lock *lock)
        
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+        int result;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock_do_i_hold(lock));
+
+        wchan_lock(cv->cv_wchan);
+        lock_release(lock);
+        result = wchan_sleep_timeout(cv->cv_wchan, ticks);
+        lock_acquire(lock);
+
+        return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
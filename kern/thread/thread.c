@@ -50,6 +50,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <timer.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,6 +58,9 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Most exited threads (with their stacks) each cpu keeps for reuse. */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -112,26 +116,25 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Initialize a thread structure, either freshly allocated or taken
+ * from the thread cache. Everything is set up except t_stack, which
+ * the caller looks after.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_init(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < THREAD_NAMEBUF) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
 	}
-
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			return ENOMEM;
+		}
 	}
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
@@ -139,21 +142,79 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
+	thread->t_cpumask = CPUMASK_ALL;
 	thread->t_proc = NULL;
+	thread->t_wchan = NULL;
+	thread->t_timedout = false;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Priority fields */
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_waitlock = NULL;
+	thread->t_lkwaitnext = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* Accounting fields */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_intr_user = false;
+
 	/* If you add to struct thread, be sure to initialize here */
 
+	return 0;
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+	if (thread_init(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->t_stack = NULL;
+
 	return thread;
 }
 
+static void thread_switch(threadstate_t newstate, struct wchan *wc);
+
+/*
+ * Each cpu's idle thread. A thread leaving a cpu it may no longer run
+ * on switches to this one if there's nothing else to run, so that it
+ * can be handed off (see thread_handoff) without the idle loop in
+ * thread_switch running on its stack. All the idle thread does is
+ * switch straight back out, idling in thread_switch until something
+ * is runnable. It is never on a run queue.
+ */
+static
+void
+thread_idle(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	while (1) {
+		thread_switch(S_READY, NULL);
+	}
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -166,7 +227,7 @@ struct cpu *
 cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
-	int result;
+	int result, i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -179,20 +240,32 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	c->c_handoff = NULL;
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
+	for (i=0; i<NPRI; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	c->c_runbits = 0;
+	c->c_runcount = 0;
+	c->c_runstale = false;
 	spinlock_init(&c->c_runqueue_lock);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_req = 0;
+	c->c_shootdown_done = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	if (c->c_number >= 32) {
+		panic("cpu_create: too many cpus for affinity masks\n");
+	}
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -222,22 +295,38 @@ cpu_create(unsigned hardware_number)
 	}
 	c->c_curthread->t_cpu = c;
 
+	snprintf(namebuf, sizeof(namebuf), "<idle #%d>", c->c_number);
+	c->c_idlethread = thread_create(namebuf);
+	if (c->c_idlethread == NULL) {
+		panic("cpu_create: thread_create failed\n");
+	}
+	result = proc_addthread(kproc, c->c_idlethread);
+	if (result) {
+		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
+	}
+	c->c_idlethread->t_stack = kmalloc(STACK_SIZE);
+	if (c->c_idlethread->t_stack == NULL) {
+		panic("cpu_create: couldn't allocate stack");
+	}
+	thread_checkstack_init(c->c_idlethread);
+	c->c_idlethread->t_cpu = c;
+	c->c_idlethread->t_cpumask = CPU_MASKBIT(c);
+	/* See thread_fork */
+	c->c_idlethread->t_iplhigh_count++;
+	switchframe_init(c->c_idlethread, thread_idle, NULL, 0);
+
 	cpu_machdep_init(c);
 
 	return c;
 }
 
 /*
- * Destroy a thread.
- *
- * This function cannot be called in the victim thread's own context.
- * Nor can it be called on a running thread.
- *
- * (Freeing the stack you're actually using to run is ... inadvisable.)
+ * Undo thread_init: clean up everything but the stack and the thread
+ * structure itself.
  */
 static
 void
-thread_destroy(struct thread *thread)
+thread_cleanup(struct thread *thread)
 {
 	KASSERT(thread != curthread);
 	KASSERT(thread->t_state != S_RUN);
@@ -249,19 +338,93 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
+	KASSERT(thread->t_waitlock == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Destroy a thread.
+ *
+ * This function cannot be called in the victim thread's own context.
+ * Nor can it be called on a running thread.
+ *
+ * (Freeing the stack you're actually using to run is ... inadvisable.)
+ */
+static
+void
+thread_destroy(struct thread *thread)
+{
+	thread_cleanup(thread);
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
+/*
+ * Thread cache.
+ *
+ * Rather than freeing exited threads and their stacks, exorcise puts
+ * up to THREAD_CACHE_MAX of them on a per-cpu list, and thread_fork
+ * takes them back off again, which saves two kmallocs and two kfrees
+ * per thread. The list is only touched by its own cpu, with
+ * interrupts off.
+ */
+static
+void
+thread_cache_put(struct thread *thread)
+{
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		thread_destroy(thread);
+		return;
+	}
+
+	/* Make sure the stack didn't overflow in its previous life. */
+	thread_checkstack(thread);
+
+	thread_cleanup(thread);
+	threadlistnode_init(&thread->t_listnode, thread);
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+}
+
+/*
+ * Get a thread with a stack from the cache, initialized with name NAME,
+ * or NULL if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	if (thread_init(thread, name)) {
+		kfree(thread->t_stack);
+		kfree(thread);
+		return NULL;
+	}
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
@@ -277,7 +440,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_cache_put(z);
 	}
 }
 
@@ -300,12 +463,12 @@ thread_panic(void)
 	 * Drop runnable threads on the floor.
 	 *
 	 * Don't try to get the run queue lock; we might not be able
-	 * to.  Instead, blat the list structure by hand, and take the
-	 * risk that it might not be quite atomic.
+	 * to.  Instead, clear the nonempty bits by hand, so nothing
+	 * on the queues can be chosen again, and take the risk that
+	 * it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = NULL;
-	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	curcpu->c_runbits = 0;
+	curcpu->c_runcount = 0;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -426,6 +589,111 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue handling.
+ *
+ * Each cpu has one FIFO run queue per priority level and a bitmap of
+ * which ones are nonempty; threads of equal priority run round-robin.
+ * All of these are called with the cpu's run queue lock held.
+ */
+
+#if NPRI > 32
+#error "c_runbits has too few bits for NPRI"
+#endif
+
+/*
+ * Index of the highest set bit in a nonzero word. MIPS-I has no
+ * count-leading-zeros instruction, so binary search.
+ */
+static
+unsigned
+runqueue_topbit(uint32_t bits)
+{
+	unsigned n = 0;
+
+	KASSERT(bits != 0);
+	if (bits & 0xffff0000) {
+		n += 16;
+		bits >>= 16;
+	}
+	if (bits & 0xff00) {
+		n += 8;
+		bits >>= 8;
+	}
+	if (bits & 0xf0) {
+		n += 4;
+		bits >>= 4;
+	}
+	if (bits & 0xc) {
+		n += 2;
+		bits >>= 2;
+	}
+	if (bits & 0x2) {
+		n += 1;
+	}
+	return n;
+}
+
+/*
+ * Put T at the back of the queue for its effective priority.
+ */
+static
+void
+runqueue_add(struct cpu *c, struct thread *t)
+{
+	KASSERT(t->t_pri >= PRI_MIN && t->t_pri <= PRI_MAX);
+
+	threadlist_addtail(&c->c_runqueue[t->t_pri], t);
+	c->c_runbits |= (uint32_t)1 << t->t_pri;
+	c->c_runcount++;
+}
+
+/*
+ * Take T off the queue for priority level PRI.
+ */
+static
+void
+runqueue_remove(struct cpu *c, struct thread *t, int pri)
+{
+	threadlist_remove(&c->c_runqueue[pri], t);
+	if (threadlist_isempty(&c->c_runqueue[pri])) {
+		c->c_runbits &= ~((uint32_t)1 << pri);
+	}
+	c->c_runcount--;
+}
+
+/*
+ * Priority of the most important runnable thread, or -1 if none.
+ */
+static
+int
+runqueue_toppri(struct cpu *c)
+{
+	if (c->c_runbits == 0) {
+		return -1;
+	}
+	return runqueue_topbit(c->c_runbits);
+}
+
+/*
+ * Dequeue the most important runnable thread, or return NULL.
+ */
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	struct thread *t;
+	int pri;
+
+	pri = runqueue_toppri(c);
+	if (pri < 0) {
+		return NULL;
+	}
+	t = c->c_runqueue[pri].tl_head.tln_next->tln_self;
+	runqueue_remove(c, t, pri);
+	return t;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -450,7 +718,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_add(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -464,6 +732,63 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Choose a cpu for a thread with affinity mask MASK that is moving or
+ * starting up: the allowed cpu with the fewest runnable threads,
+ * preferring the current cpu on a tie. The counts are read without
+ * locking; they're only a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(uint32_t mask)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus;
+
+	best = NULL;
+	if (mask & CPU_MASKBIT(curcpu)) {
+		best = curcpu->c_self;
+	}
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if ((mask & CPU_MASKBIT(c)) == 0) {
+			continue;
+		}
+		if (best == NULL || c->c_runcount < best->c_runcount) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Finish moving a thread that switched away from this cpu because its
+ * affinity mask no longer includes it. It can't be put on another
+ * cpu's run queue until we're off its stack, so thread_switch leaves
+ * it in c_handoff for whoever runs next. Called with interrupts off
+ * but without the run queue lock, from the tail of thread_switch and
+ * from thread_startup.
+ */
+static
+void
+thread_handoff(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_handoff;
+	if (t == NULL) {
+		return;
+	}
+	curcpu->c_handoff = NULL;
+
+	t->t_cpu = thread_pickcpu(t->t_cpumask);
+	DEBUG(DB_THREADS, "Moved thread %s: cpu %u -> %u",
+	      t->t_name, curcpu->c_number, t->t_cpu->c_number);
+	thread_make_runnable(t, false);
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -471,8 +796,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
  *
  * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * process is inherited from the caller, as is the affinity mask. It
+ * will start on the same CPU as the caller if the mask allows, and
+ * otherwise on the least busy CPU it does allow, unless the scheduler
+ * intervenes first.
  */
 int
 thread_fork(const char *name,
@@ -487,16 +814,20 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread and its stack if we can. */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
@@ -505,7 +836,17 @@ thread_fork(const char *name,
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpumask = curthread->t_cpumask;
+	if (newthread->t_cpumask & CPU_MASKBIT(curcpu)) {
+		newthread->t_cpu = curthread->t_cpu;
+	}
+	else {
+		newthread->t_cpu = thread_pickcpu(newthread->t_cpumask);
+	}
+
+	/* Priority is inherited, but not any boost the parent is holding */
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_pri = curthread->t_basepri;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -528,7 +869,7 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the chosen cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
@@ -548,6 +889,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	bool leaving, idling;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -573,8 +915,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. That
+	 * includes yielding when everything runnable is less important
+	 * than we are.
+	 *
+	 * A thread whose affinity mask excludes this cpu always
+	 * switches, so it can be handed off to another cpu; if there's
+	 * nothing else to run, it switches to the idle thread. The
+	 * idle thread always switches too.
+	 */
+	leaving = (newstate == S_READY &&
+		   (cur->t_cpumask & CPU_MASKBIT(curcpu)) == 0);
+	idling = (cur == curcpu->c_idlethread);
+	if (newstate == S_READY && !leaving && !idling &&
+	    runqueue_toppri(curcpu) < cur->t_pri) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -585,9 +940,22 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (idling) {
+			/* not queued; see thread_idle */
+			break;
+		}
+		cur->t_usage.tu_nivcsw++;
+		if (leaving) {
+			/* see thread_handoff */
+			KASSERT(curcpu->c_handoff == NULL);
+			curcpu->c_handoff = cur;
+		}
+		else {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
 		break;
 	    case S_SLEEP:
+		cur->t_usage.tu_nvcsw++;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -603,6 +971,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * without racing. Exercise: what's the other?)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -632,7 +1001,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runqueue_remhead(curcpu);
+		if (next == NULL && curcpu->c_handoff != NULL) {
+			/* Get off the leaving thread's stack. */
+			next = curcpu->c_idlethread;
+		}
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
 			cpu_idle();
@@ -708,6 +1081,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the thread we switched from, if it is moving. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -741,6 +1117,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the thread we switched from, if it is moving. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -773,7 +1152,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
  *
  * The parts of the thread structure we don't actually need to run
  * should be cleaned up right away. The rest has to wait until
- * thread_destroy is called from exorcise().
+ * thread_destroy (or thread_cache_put) is called from exorcise().
  *
  * Does not return.
  */
@@ -817,6 +1196,59 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+/*
+ * Change the current thread's base priority. Yield afterwards so
+ * that if we just became less important than something runnable, it
+ * gets to go.
+ */
+void
+thread_setpriority(int pri)
+{
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	curthread->t_basepri = pri;
+	lock_pi_recompute();
+	thread_yield();
+}
+
+int
+thread_setaffinity(uint32_t mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 32) {
+		mask &= ((uint32_t)1 << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	curthread->t_cpumask = mask;
+	if ((mask & CPU_MASKBIT(curcpu)) == 0) {
+		/* thread_switch hands us off to an allowed cpu */
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * Flag T's cpu so schedule() re-files T under its new priority. T
+ * may migrate while we're looking; that's harmless, because the
+ * migration code queues threads by whatever t_pri is at the time,
+ * and a flag left on the wrong cpu only costs that cpu one scan.
+ */
+void
+thread_priority_changed(struct thread *t)
+{
+	struct cpu *c;
+
+	c = t->t_cpu;
+	spinlock_acquire(&c->c_runqueue_lock);
+	c->c_runstale = true;
+	spinlock_release(&c->c_runqueue_lock);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -824,15 +1256,43 @@ thread_yield(void)
  *
  * This is called periodically from hardclock(). It should reshuffle
  * the current CPU's run queue by job priority.
+ *
+ * Threads are queued by priority by thread_make_runnable. A queued
+ * thread can only end up at the wrong level when priority inheritance
+ * raises its priority; thread_priority_changed flags the cpu when
+ * that happens, and here we move such threads to the right queue.
  */
 
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlistnode *tln, *nexttln;
+	struct thread *t;
+	uint32_t bits;
+	int pri;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+
+	if (curcpu->c_runstale) {
+		curcpu->c_runstale = false;
+		bits = curcpu->c_runbits;
+		while (bits != 0) {
+			pri = runqueue_topbit(bits);
+			bits &= ~((uint32_t)1 << pri);
+
+			tln = curcpu->c_runqueue[pri].tl_head.tln_next;
+			for (; tln->tln_next != NULL; tln = nexttln) {
+				nexttln = tln->tln_next;
+				t = tln->tln_self;
+				if (t->t_pri != pri) {
+					runqueue_remove(curcpu, t, pri);
+					runqueue_add(curcpu, t);
+				}
+			}
+		}
+	}
+
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
@@ -859,16 +1319,19 @@ thread_consider_migration(void)
 	unsigned i, numcpus;
 	struct cpu *c;
 	struct threadlist victims;
+	struct threadlistnode *tln, *prevtln, *nexttln;
 	struct thread *t;
+	uint32_t bits;
+	int pri;
 
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
+		total_count += c->c_runcount;
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			my_count = c->c_runcount;
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
@@ -878,57 +1341,69 @@ thread_consider_migration(void)
 		return;
 	}
 
+	/*
+	 * Pick the victims: the least important threads that are
+	 * allowed to run somewhere else.
+	 *
+	 * Ordinarily, curthread will not appear on the run queue.
+	 * However, it can under the following circumstances:
+	 *   - it went to sleep;
+	 *   - the processor became idle, so it remained curthread;
+	 *   - it was reawakened, so it was put on the run queue;
+	 *   - and the processor hasn't fully unidled yet, so all
+	 *     these things are still true.
+	 *
+	 * If the timer interrupt happens at (almost) exactly the
+	 * proper moment, we can come here while things are in this
+	 * state and see curthread. However, *migrating* curthread can
+	 * cause bad things to happen (Exercise: Why? And what?) so
+	 * leave it where it is.
+	 */
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	bits = curcpu->c_runbits;
+	while (bits != 0 && victims.tl_count < to_send) {
+		/* lowest nonempty level first */
+		pri = runqueue_topbit(bits & -bits);
+		bits &= ~((uint32_t)1 << pri);
+
+		tln = curcpu->c_runqueue[pri].tl_tail.tln_prev;
+		for (; tln->tln_prev != NULL && victims.tl_count < to_send;
+		     tln = prevtln) {
+			prevtln = tln->tln_prev;
+			t = tln->tln_self;
+			if (t == curthread ||
+			    (t->t_cpumask & ~CPU_MASKBIT(curcpu)) == 0) {
+				continue;
+			}
+			runqueue_remove(curcpu, t, pri);
+			threadlist_addhead(&victims, t);
+		}
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+	for (i=0; i < numcpus && !threadlist_isempty(&victims); i++) {
 		c = cpuarray_get(&allcpus, i);
 		if (c == curcpu->c_self) {
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
+		tln = victims.tl_head.tln_next;
+		while (c->c_runcount < one_share && tln->tln_next != NULL) {
+			nexttln = tln->tln_next;
+			t = tln->tln_self;
+			tln = nexttln;
+			if ((t->t_cpumask & CPU_MASKBIT(c)) == 0) {
 				continue;
 			}
 
+			threadlist_remove(&victims, t);
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			runqueue_add(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
 			if (c->c_isidle) {
 				/*
 				 * Other processor is idle; send
@@ -942,13 +1417,14 @@ thread_consider_migration(void)
 
 	/*
 	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * changed while we were working, and the cpus with room may not
+	 * be ones the victims are allowed on, so we may end up with
+	 * leftovers. Don't panic; just put them back on our own run queue.
 	 */
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			runqueue_add(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -1028,6 +1504,75 @@ wchan_sleep(struct wchan *wc)
 	thread_switch(S_SLEEP, wc);
 }
 
+/*
+ * Timed sleep.
+ *
+ * The timer callback takes the thread off the channel itself, unless
+ * a wakeup got there first; whichever of the two removes the thread
+ * from wc_threads (under wc_lock) is the one that makes it runnable.
+ * The sleeper stops the timer before returning, and timer_stop waits
+ * out a callback in progress, so the stack-allocated timer and
+ * wchan_timeout are never used after they go away.
+ */
+struct wchan_timeout {
+	struct wchan *wt_wchan;
+	struct thread *wt_thread;
+};
+
+static
+void
+wchan_timeout(void *data)
+{
+	struct wchan_timeout *wt = data;
+	struct wchan *wc = wt->wt_wchan;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(&wc->wc_lock);
+	if (target->t_wchan != wc) {
+		/* Already woken up. */
+		spinlock_release(&wc->wc_lock);
+		return;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	target->t_timedout = true;
+	spinlock_release(&wc->wc_lock);
+
+	thread_make_runnable(target, false);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS hardclock ticks. Returns
+ * 0 if woken up and ETIMEDOUT if the time ran out. The channel must
+ * be locked, and will be *unlocked* upon return.
+ */
+int
+wchan_sleep_timeout(struct wchan *wc, unsigned ticks)
+{
+	struct wchan_timeout wt;
+	struct timer tm;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	if (ticks == 0) {
+		wchan_unlock(wc);
+		return ETIMEDOUT;
+	}
+
+	wt.wt_wchan = wc;
+	wt.wt_thread = curthread;
+	curthread->t_timedout = false;
+	timer_init(&tm, wchan_timeout, &wt);
+	timer_start(&tm, ticks);
+
+	thread_switch(S_SLEEP, wc);
+
+	timer_stop(&tm);
+	return curthread->t_timedout ? ETIMEDOUT : 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1039,6 +1584,9 @@ wchan_wakeone(struct wchan *wc)
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
 	target = threadlist_remhead(&wc->wc_threads);
+	if (target != NULL) {
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1053,6 +1601,25 @@ wchan_wakeone(struct wchan *wc)
 	thread_make_runnable(target, false);
 }
 
+/*
+ * Wake up one particular thread, if it's sleeping on a wait channel.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct thread *target)
+{
+	spinlock_acquire(&wc->wc_lock);
+	if (target->t_wchan != wc) {
+		spinlock_release(&wc->wc_lock);
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	spinlock_release(&wc->wc_lock);
+
+	thread_make_runnable(target, false);
+	return true;
+}
+
 /*
  * Wake up all threads sleeping on a wait channel.
  */
@@ -1070,6 +1637,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1140,28 +1708,94 @@ ipi_broadcast(int code)
 	}
 }
 
-void
-ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+/*
+ * Queue N shootdowns for TARGET, and interrupt it unless it already
+ * has some pending. Returns the batch's ticket; *SENT is set if an
+ * IPI was sent. Caller holds TARGET's IPI lock.
+ */
+static
+unsigned
+ipi_queue_shootdowns(struct cpu *target,
+		     const struct tlbshootdown *mappings, unsigned n,
+		     bool *sent)
 {
-	int n;
+	unsigned i;
+	int num;
 
-	spinlock_acquire(&target->c_ipi_lock);
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
 
-	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
-		target->c_numshootdown = TLBSHOOTDOWN_ALL;
+	for (i=0; i<n; i++) {
+		num = target->c_numshootdown;
+		if (num == TLBSHOOTDOWN_ALL) {
+			break;
+		}
+		if (num == TLBSHOOTDOWN_MAX) {
+			target->c_numshootdown = TLBSHOOTDOWN_ALL;
+			break;
+		}
+		target->c_shootdown[num] = mappings[i];
+		target->c_numshootdown = num+1;
 	}
-	else {
-		target->c_shootdown[n] = *mapping;
-		target->c_numshootdown = n+1;
+
+	*sent = false;
+	if ((target->c_ipi_pending & ((uint32_t)1 << IPI_TLBSHOOTDOWN)) == 0) {
+		target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
+		mainbus_send_ipi(target);
+		*sent = true;
 	}
+	return ++target->c_shootdown_req;
+}
 
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
+void
+ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	bool sent;
 
+	spinlock_acquire(&target->c_ipi_lock);
+	ipi_queue_shootdowns(target, mapping, 1, &sent);
 	spinlock_release(&target->c_ipi_lock);
 }
 
+unsigned
+ipi_tlbshootdown_mask(uint32_t cpumask,
+		      const struct tlbshootdown *mappings, unsigned n)
+{
+	unsigned tickets[32];
+	unsigned i, numcpus, ipis = 0;
+	struct cpu *c;
+	bool sent;
+
+	numcpus = cpuarray_num(&allcpus);
+	KASSERT(numcpus <= 32);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self || (cpumask & CPU_MASKBIT(c)) == 0) {
+			continue;
+		}
+		spinlock_acquire(&c->c_ipi_lock);
+		tickets[i] = ipi_queue_shootdowns(c, mappings, n, &sent);
+		spinlock_release(&c->c_ipi_lock);
+		if (sent) {
+			ipis++;
+		}
+	}
+
+	/*
+	 * Wait for them all, with interrupts on so that a cpu
+	 * shooting at us meanwhile isn't kept waiting too.
+	 */
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self || (cpumask & CPU_MASKBIT(c)) == 0) {
+			continue;
+		}
+		while ((int)(c->c_shootdown_done - tickets[i]) < 0) {
+			/* spin */
+		}
+	}
+	return ipis;
+}
+
 void
 interprocessor_interrupt(void)
 {
@@ -1202,8 +1836,24 @@ interprocessor_interrupt(void)
 			}
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdown_done = curcpu->c_shootdown_req;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
 }
+
+void
+thread_usage_add(struct thread_usage *to, const struct thread_usage *from)
+{
+	to->tu_uticks += from->tu_uticks;
+	to->tu_sticks += from->tu_sticks;
+	to->tu_minflt += from->tu_minflt;
+	to->tu_majflt += from->tu_majflt;
+	to->tu_nvcsw += from->tu_nvcsw;
+	to->tu_nivcsw += from->tu_nivcsw;
+	to->tu_inblock += from->tu_inblock;
+	to->tu_oublock += from->tu_oublock;
+	to->tu_inbytes += from->tu_inbytes;
+	to->tu_outbytes += from->tu_outbytes;
+}
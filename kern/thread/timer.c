@@ -0,0 +1,210 @@
+/*
+ * Hierarchical timer wheel.
+ *
+ * The wheel has TW_LEVELS levels of TW_SIZE slots each. Level 0 has
+ * one slot per tick and holds timers due within the next TW_SIZE
+ * ticks; each slot of level N covers TW_SIZE^N ticks. When the level
+ * 0 index wraps around, the level 1 slot for the coming TW_SIZE ticks
+ * is emptied and its timers are redistributed into level 0, and so
+ * on up the levels. Every timer is thus touched at most TW_LEVELS
+ * times between being started and firing, however far out it is.
+ *
+ * Timers further out than the wheel can represent (about 2^24 ticks;
+ * 46 hours at HZ=100) are parked in the last slot and will fire early.
+ *
+ * Only cpu 0 advances the wheel. Callbacks are run one at a time with
+ * tw_lock released; tw_running records which one is in progress so
+ * timer_stop can wait for it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <timer.h>
+
+#define TW_BITS		6
+#define TW_SIZE		(1U << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	4
+#define TW_MAXDELTA	((1U << (TW_BITS * TW_LEVELS)) - 1)
+
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
+static struct timer *tw_wheel[TW_LEVELS][TW_SIZE];
+static struct timer *tw_expired;	/* due on the tick being processed */
+static struct timer *tw_running;	/* callback currently running */
+static volatile unsigned tw_now;	/* next tick to be processed */
+
+/*
+ * List handling. Each slot is a doubly-linked list with a back
+ * pointer to whatever points at the timer, so a timer can be taken
+ * out without knowing which slot it is in.
+ */
+static
+void
+tw_link(struct timer **head, struct timer *tm)
+{
+	tm->tm_next = *head;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_pprev = &tm->tm_next;
+	}
+	*head = tm;
+	tm->tm_pprev = head;
+}
+
+static
+void
+tw_unlink(struct timer *tm)
+{
+	*tm->tm_pprev = tm->tm_next;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_pprev = tm->tm_pprev;
+	}
+	tm->tm_next = NULL;
+	tm->tm_pprev = NULL;
+}
+
+/*
+ * Put a timer in the right slot for its deadline. Caller holds tw_lock.
+ */
+static
+void
+tw_insert(struct timer *tm)
+{
+	unsigned delta, idx;
+	int level;
+
+	delta = tm->tm_expires - tw_now;
+	if ((int)delta < 0) {
+		/* Already due; run it on the next tick. */
+		tm->tm_expires = tw_now;
+		delta = 0;
+	}
+	else if (delta > TW_MAXDELTA) {
+		tm->tm_expires = tw_now + TW_MAXDELTA;
+		delta = TW_MAXDELTA;
+	}
+
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1U << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	idx = (tm->tm_expires >> (TW_BITS * level)) & TW_MASK;
+	tw_link(&tw_wheel[level][idx], tm);
+}
+
+/*
+ * Redistribute the slot of LEVEL that covers the ticks starting at
+ * tw_now into the levels below it. Caller holds tw_lock.
+ */
+static
+void
+tw_cascade(int level)
+{
+	struct timer *list, *tm;
+	unsigned idx;
+
+	idx = (tw_now >> (TW_BITS * level)) & TW_MASK;
+	list = tw_wheel[level][idx];
+	tw_wheel[level][idx] = NULL;
+	while ((tm = list) != NULL) {
+		list = tm->tm_next;
+		tm->tm_next = NULL;
+		tm->tm_pprev = NULL;
+		tw_insert(tm);
+	}
+}
+
+void
+timer_init(struct timer *tm, void (*func)(void *), void *data)
+{
+	tm->tm_next = NULL;
+	tm->tm_pprev = NULL;
+	tm->tm_expires = 0;
+	tm->tm_func = func;
+	tm->tm_data = data;
+}
+
+void
+timer_start(struct timer *tm, unsigned ticks)
+{
+	KASSERT(tm->tm_func != NULL);
+
+	spinlock_acquire(&tw_lock);
+	if (tm->tm_pprev != NULL) {
+		tw_unlink(tm);
+	}
+	tm->tm_expires = tw_now + ticks;
+	tw_insert(tm);
+	spinlock_release(&tw_lock);
+}
+
+bool
+timer_stop(struct timer *tm)
+{
+	bool pending;
+
+	spinlock_acquire(&tw_lock);
+	pending = (tm->tm_pprev != NULL);
+	if (pending) {
+		tw_unlink(tm);
+	}
+	while (tw_running == tm) {
+		/*
+		 * The callback is running on cpu 0; let it finish.
+		 * (If we *are* cpu 0, we aren't running in the callback,
+		 * because it would have had to interrupt us while we
+		 * held tw_lock; so we can't deadlock here unless the
+		 * callback stops its own timer, which isn't allowed.)
+		 */
+		spinlock_release(&tw_lock);
+		spinlock_acquire(&tw_lock);
+	}
+	spinlock_release(&tw_lock);
+	return pending;
+}
+
+unsigned
+timer_ticks(void)
+{
+	return tw_now;
+}
+
+void
+timer_tick(void)
+{
+	struct timer *tm;
+	int level;
+
+	spinlock_acquire(&tw_lock);
+
+	/* Cascade down from the higher levels as their slots come due. */
+	for (level = 1; level < TW_LEVELS; level++) {
+		if ((tw_now >> (TW_BITS * (level - 1))) & TW_MASK) {
+			break;
+		}
+		tw_cascade(level);
+	}
+
+	/* Take this tick's slot and run everything in it. */
+	KASSERT(tw_expired == NULL);
+	tw_expired = tw_wheel[0][tw_now & TW_MASK];
+	tw_wheel[0][tw_now & TW_MASK] = NULL;
+	if (tw_expired != NULL) {
+		tw_expired->tm_pprev = &tw_expired;
+	}
+	tw_now++;
+
+	while ((tm = tw_expired) != NULL) {
+		tw_unlink(tm);
+		tw_running = tm;
+		spinlock_release(&tw_lock);
+
+		tm->tm_func(tm->tm_data);
+
+		spinlock_acquire(&tw_lock);
+		tw_running = NULL;
+	}
+
+	spinlock_release(&tw_lock);
+}
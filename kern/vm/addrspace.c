@@ -0,0 +1,722 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Address spaces: page tables, faults, and the as_ operations. See
+ * addrspace.h and vmprivate.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <clock.h>
+#include <timer.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <swap.h>
+#include <uw-vmstats.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/* All address spaces, for load control and reports */
+struct addrspace *as_all;
+struct spinlock as_all_lock = SPINLOCK_INITIALIZER;
+static unsigned as_nextseq;
+
+/*
+ * Page table operations. The page table covers everything but
+ * mappings: the program's regions, the stack and the heap. The first
+ * fault on a page works out what it should hold from where it is;
+ * after that its entry says where it is, so a fault on a page that has
+ * been touched before - by far the most common kind, since the TLB is
+ * small - needs only a page table lookup however sparse the address
+ * space. The TLB is loaded before mm_lock is let go, so the page can't
+ * be paged out from under us.
+ */
+
+/*
+ * Handle a fault on page VADDR of AS, whose entry *PTE is nonzero.
+ * Caller holds mm_lock.
+ */
+static
+int
+pte_fault(struct addrspace *as, int faulttype, vaddr_t vaddr, pte_t *pte)
+{
+	paddr_t paddr;
+	bool writeable = true;
+	int result;
+
+	if (*pte & PTE_READONLY) {
+		if (faulttype != VM_FAULT_READ) {
+			/* Write to a text page: kill the process. */
+			return EFAULT;
+		}
+		tlb_load(as, vaddr, *pte & PTE_FRAME, false);
+		return 0;
+	}
+	vm_loadcontrol(as);
+	if (*pte & PTE_SWAPPED) {
+		result = page_swapin(as, vaddr, pte);
+		if (result) {
+			return result;
+		}
+	}
+	paddr = *pte & PTE_FRAME;
+	page_use(paddr, faulttype, &writeable);
+	tlb_load(as, vaddr, paddr, writeable);
+	return 0;
+}
+
+/*
+ * First touch of page VADDR of AS, which starts out all zeros: of the
+ * stack, the heap, or the part of a region not in the file. Reading it
+ * maps zero_page, read-only, and it gets a frame of its own when it is
+ * first written. Caller holds mm_lock.
+ */
+static
+int
+zero_fault(struct addrspace *as, int faulttype, vaddr_t vaddr)
+{
+	paddr_t paddr;
+	pte_t *pte;
+
+	vm_loadcontrol(as);
+	if (faulttype == VM_FAULT_READ) {
+		tlb_load(as, vaddr, zero_page, false);
+		return 0;
+	}
+	pte = pt_alloc(as->as_pt, vaddr);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+	KASSERT(*pte == 0);
+	paddr = getzeropage();
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	*pte = paddr | PTE_VALID;
+	page_setowner(paddr, as, vaddr, false, 0);
+	vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+	vm_pagein(false);
+	tlb_load(as, vaddr, paddr, true);
+	return 0;
+}
+
+/*
+ * First touch of page VADDR of a writeable region loaded by SL. The
+ * page is read in without mm_lock, as in mmobj_page; nobody else can
+ * fill in our page table meanwhile.
+ */
+static
+int
+data_fault(struct addrspace *as, struct segload *sl, int faulttype,
+	   vaddr_t vaddr)
+{
+	paddr_t paddr;
+	pte_t *pte;
+	int result;
+
+	lock_acquire(mm_lock);
+	if (segload_zeroonly(sl, vaddr)) {
+		result = zero_fault(as, faulttype, vaddr);
+		lock_release(mm_lock);
+		return result;
+	}
+	vm_loadcontrol(as);
+	lock_release(mm_lock);
+
+	paddr = getuserpages(1);
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	result = segload_page(sl, vaddr, paddr);
+	if (result) {
+		free_ppages(paddr);
+		return result;
+	}
+
+	lock_acquire(mm_lock);
+	pte = pt_alloc(as->as_pt, vaddr);
+	if (pte == NULL) {
+		lock_release(mm_lock);
+		free_ppages(paddr);
+		return ENOMEM;
+	}
+	KASSERT(*pte == 0);
+	*pte = paddr | PTE_VALID;
+	page_setowner(paddr, as, vaddr, false, 0);
+	tlb_load(as, vaddr, paddr, true);
+	lock_release(mm_lock);
+	return 0;
+}
+
+/*
+ * First touch by AS of page VADDR of text TS.
+ */
+static
+int
+text_fault(struct addrspace *as, struct textseg *ts, int faulttype,
+	   vaddr_t vaddr)
+{
+	paddr_t paddr;
+	pte_t *pte;
+	int result;
+
+	if (faulttype != VM_FAULT_READ) {
+		return EFAULT;
+	}
+	result = text_page(ts, vaddr, &paddr);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(mm_lock);
+	pte = pt_alloc(as->as_pt, vaddr);
+	if (pte == NULL) {
+		lock_release(mm_lock);
+		return ENOMEM;
+	}
+	*pte = paddr | PTE_VALID | PTE_READONLY;
+	tlb_load(as, vaddr, paddr, false);
+	lock_release(mm_lock);
+	return 0;
+}
+
+static
+int
+pte_discard(void *data, vaddr_t vaddr, pte_t *pte)
+{
+	(void)data;
+	(void)vaddr;
+
+	if (*pte & PTE_READONLY) {
+		/* text; its textseg frees it */
+		*pte = 0;
+	}
+	else {
+		page_discard(pte);
+	}
+	return 0;
+}
+
+/*
+ * Give back the pages of AS in START..END-1, and make sure the TLB
+ * doesn't still map them. (Other cpus flush their TLBs when they
+ * switch to us, so only this one can have stale entries.) Caller
+ * holds mm_lock.
+ */
+static
+void
+pt_free(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	pt_foreach(as->as_pt, start, end, pte_discard, NULL);
+	swtlb_flush(as);
+	if (as == curproc_getas()) {
+		tlb_unmap(start, end);
+	}
+}
+
+static
+int
+pte_copy(void *data, vaddr_t vaddr, pte_t *pte)
+{
+	struct addrspace *new = data;
+	pte_t *npte;
+
+	npte = pt_alloc(new->as_pt, vaddr);
+	if (npte == NULL) {
+		return ENOMEM;
+	}
+	if (*pte & PTE_READONLY) {
+		/* text is shared */
+		*npte = *pte;
+		return 0;
+	}
+	return page_copy(pte, new, vaddr, npte);
+}
+
+/*
+ * Copy the page table for fork. Untouched pages stay untouched.
+ */
+static
+int
+pt_copy(struct addrspace *old, struct addrspace *new)
+{
+	int result;
+
+	lock_acquire(mm_lock);
+	result = pt_foreach(old->as_pt, 0, USERSPACETOP, pte_copy, new);
+	lock_release(mm_lock);
+	return result;
+}
+
+/*
+ * Handle a fault on page VADDR of AS.
+ */
+int
+as_fault(struct addrspace *as, int faulttype, vaddr_t vaddr)
+{
+	vaddr_t vtop1, vtop2;
+	struct mmregion *mr;
+	pte_t *pte;
+	int result;
+
+	lock_acquire(mm_lock);
+	pte = pt_lookup(as->as_pt, vaddr);
+	if (pte != NULL && *pte != 0) {
+		/* the usual case: it's been touched before */
+		result = pte_fault(as, faulttype, vaddr, pte);
+		lock_release(mm_lock);
+		return result;
+	}
+	lock_release(mm_lock);
+
+	mr = mmap_find(as, vaddr);
+	if (mr != NULL) {
+		return mmap_fault(as, mr, faulttype, vaddr);
+	}
+
+	vtop1 = as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
+	vtop2 = as->as_vbase2 + as->as_npages2 * PAGE_SIZE;
+	if (vaddr >= as->as_vbase1 && vaddr < vtop1) {
+		if (as->as_text1 != NULL) {
+			return text_fault(as, as->as_text1, faulttype, vaddr);
+		}
+		KASSERT(as->as_load1 != NULL);
+		return data_fault(as, as->as_load1, faulttype, vaddr);
+	}
+	if (vaddr >= as->as_vbase2 && vaddr < vtop2) {
+		if (as->as_text2 != NULL) {
+			return text_fault(as, as->as_text2, faulttype, vaddr);
+		}
+		KASSERT(as->as_load2 != NULL);
+		return data_fault(as, as->as_load2, faulttype, vaddr);
+	}
+	if ((vaddr >= VM_STACKBASE && vaddr < USERSTACK) ||
+	    (vaddr >= as->as_heapbase &&
+	     vaddr < ROUNDUP(as->as_heaptop, PAGE_SIZE))) {
+		lock_acquire(mm_lock);
+		result = zero_fault(as, faulttype, vaddr);
+		lock_release(mm_lock);
+		return result;
+	}
+	return EFAULT;
+}
+
+struct addrspace *
+as_create(void)
+{
+	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	if (as==NULL) {
+		return NULL;
+	}
+
+	as->as_vbase1 = 0;
+	as->as_npages1 = 0;
+	as->as_vbase2 = 0;
+	as->as_npages2 = 0;
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->as_writeable1 = true;
+	as->as_writeable2 = true;
+	as->as_text1 = NULL;
+	as->as_text2 = NULL;
+	as->as_load1 = NULL;
+	as->as_load2 = NULL;
+	as->as_heapbase = 0;
+	as->as_heaptop = 0;
+	as->as_mmaps = NULL;
+	as->as_rss = 0;
+	as->as_faults = 0;
+	as->as_pfffaults = 0;
+	as->as_pffstart = timer_ticks();
+	as->as_pffrate = 0;
+	as->as_pri = PRI_DEFAULT;
+	as->as_suspended = false;
+	as->as_name[0] = '\0';
+	as->as_asid = 0;
+
+	spinlock_acquire(&as_all_lock);
+	as->as_seq = as_nextseq++;
+	as->as_next = as_all;
+	as_all = as;
+	spinlock_release(&as_all_lock);
+	lock_acquire(mm_lock);
+	swtlb_flush(as);
+	lock_release(mm_lock);
+
+	return as;
+}
+
+void
+as_destroy(struct addrspace *as)
+{
+	struct addrspace **asp;
+
+	spinlock_acquire(&as_all_lock);
+	for (asp = &as_all; *asp != as; asp = &(*asp)->as_next) {
+		KASSERT(*asp != NULL);
+	}
+	*asp = as->as_next;
+	spinlock_release(&as_all_lock);
+
+	lock_acquire(mm_lock);
+	pt_free(as, 0, USERSPACETOP);
+	/* There may be room now for a suspended process. */
+	vm_loadwakeup();
+	lock_release(mm_lock);
+	pt_destroy(as->as_pt);
+	if (as->as_text1 != NULL) {
+		text_release(as->as_text1);
+	}
+	if (as->as_text2 != NULL) {
+		text_release(as->as_text2);
+	}
+	if (as->as_load1 != NULL) {
+		segload_destroy(as->as_load1);
+	}
+	if (as->as_load2 != NULL) {
+		segload_destroy(as->as_load2);
+	}
+	if (as->as_mmaps != NULL) {
+		mmap_destroy(as);
+	}
+	kfree(as);
+}
+
+void
+as_activate(void)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		/* Kernel threads don't have an address space to activate */
+		return;
+	}
+
+	if (as->as_name[0] == '\0') {
+		snprintf(as->as_name, sizeof(as->as_name), "%s",
+			 curproc->p_name);
+	}
+	tlb_activate(as);
+}
+
+void
+as_deactivate(void)
+{
+	/* nothing */
+}
+
+int
+as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
+		 int readable, int writeable, int executable)
+{
+	size_t npages;
+
+	/* Align the region. First, the base... */
+	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
+	vaddr &= PAGE_FRAME;
+
+	/* ...and now the length. */
+	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	npages = sz / PAGE_SIZE;
+
+	/* Only writeability is enforced */
+	(void)readable;
+	(void)executable;
+
+	if (as->as_vbase1 == 0) {
+		as->as_vbase1 = vaddr;
+		as->as_npages1 = npages;
+		as->as_writeable1 = (writeable != 0);
+		return 0;
+	}
+
+	if (as->as_vbase2 == 0) {
+		as->as_vbase2 = vaddr;
+		as->as_npages2 = npages;
+		as->as_writeable2 = (writeable != 0);
+		return 0;
+	}
+
+	/*
+	 * Support for more than two regions is not available.
+	 */
+	kprintf("vm: Warning: too many regions\n");
+	return EUNIMP;
+}
+
+void
+as_share_text(struct addrspace *as, struct vnode *v)
+{
+	if (!as->as_writeable1) {
+		text_attach(v, as->as_vbase1, as->as_npages1, &as->as_text1);
+	}
+	if (!as->as_writeable2) {
+		text_attach(v, as->as_vbase2, as->as_npages2, &as->as_text2);
+	}
+}
+
+int
+as_define_file(struct addrspace *as, struct vnode *v, off_t offset,
+	       vaddr_t vaddr, size_t memsize, size_t filesize)
+{
+	struct textseg *ts;
+	struct segload *sl;
+
+	if (vaddr >= as->as_vbase1 &&
+	    vaddr < as->as_vbase1 + as->as_npages1 * PAGE_SIZE) {
+		ts = as->as_text1;
+		sl = as->as_load1;
+	}
+	else if (vaddr >= as->as_vbase2 &&
+		 vaddr < as->as_vbase2 + as->as_npages2 * PAGE_SIZE) {
+		ts = as->as_text2;
+		sl = as->as_load2;
+	}
+	else {
+		return EFAULT;
+	}
+
+	if (ts != NULL) {
+		if (ts->ts_listed) {
+			/* shared; already set up */
+			return 0;
+		}
+		sl = &ts->ts_load;
+	}
+	KASSERT(sl != NULL);
+	if (sl->sl_vnode != NULL) {
+		/* regions hold one segment each */
+		kprintf("vm: Warning: segments share a region\n");
+		return EUNIMP;
+	}
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+
+	VOP_INCREF(v);
+	sl->sl_vnode = v;
+	sl->sl_offset = offset;
+	sl->sl_vaddr = vaddr;
+	sl->sl_filesz = filesize;
+	return 0;
+}
+
+/*
+ * Set up whatever region N (base VBASE, NPAGES long) will be loaded
+ * from: a textseg of its own if it's read-only and not shared, or a
+ * loader if it's writeable.
+ */
+static
+int
+as_prepare_region(vaddr_t vbase, size_t npages, bool writeable,
+		  struct textseg **text, struct segload **load)
+{
+	if (writeable) {
+		KASSERT(*load == NULL);
+		*load = segload_create();
+		return *load == NULL ? ENOMEM : 0;
+	}
+	if (*text == NULL) {
+		*text = text_create(vbase, npages);
+		if (*text == NULL) {
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	int result;
+
+	/*
+	 * Nothing is allocated or loaded here; each page is zeroed or
+	 * read in when it is first touched, and the stack grows as it
+	 * is used.
+	 */
+	result = as_prepare_region(as->as_vbase1, as->as_npages1,
+				   as->as_writeable1, &as->as_text1,
+				   &as->as_load1);
+	if (result) {
+		return result;
+	}
+	result = as_prepare_region(as->as_vbase2, as->as_npages2,
+				   as->as_writeable2, &as->as_text2,
+				   &as->as_load2);
+	if (result) {
+		return result;
+	}
+
+	return 0;
+}
+
+int
+as_complete_load(struct addrspace *as)
+{
+	/* Now that the regions know their files, share the text. */
+	if (as->as_text1 != NULL) {
+		text_publish(as->as_text1);
+	}
+	if (as->as_text2 != NULL) {
+		text_publish(as->as_text2);
+	}
+
+	/* The heap starts out empty, just above the higher region. */
+	as->as_heapbase = as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
+	if (as->as_vbase2 + as->as_npages2 * PAGE_SIZE > as->as_heapbase) {
+		as->as_heapbase = as->as_vbase2 + as->as_npages2 * PAGE_SIZE;
+	}
+	as->as_heaptop = as->as_heapbase;
+	return 0;
+}
+
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	/* The stack is there to be touched; nothing to set up. */
+	(void)as;
+
+	*stackptr = USERSTACK;
+	return 0;
+}
+
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak)
+{
+	vaddr_t newtop, limit, oldend, newend;
+
+	KASSERT(as->as_heapbase != 0);
+	limit = mmap_floor(as);
+	if (amount < 0) {
+		if ((vaddr_t)-amount > as->as_heaptop - as->as_heapbase) {
+			return EINVAL;
+		}
+	}
+	else if ((vaddr_t)amount > limit - as->as_heaptop) {
+		return ENOMEM;
+	}
+	newtop = as->as_heaptop + amount;
+
+	oldend = ROUNDUP(as->as_heaptop, PAGE_SIZE);
+	newend = ROUNDUP(newtop, PAGE_SIZE);
+	if (newend > oldend) {
+		/*
+		 * Frames are only allocated on first touch, but don't
+		 * hand out more heap than there's memory to back; a
+		 * program probing for how much it can get (like
+		 * malloctest) should get ENOMEM, not be killed later.
+		 */
+		if ((newend - oldend) / PAGE_SIZE >
+		    coremap_avail() + swap_nfree()) {
+			return ENOMEM;
+		}
+	}
+	else if (newend < oldend) {
+		lock_acquire(mm_lock);
+		pt_free(as, newend, oldend);
+		lock_release(mm_lock);
+	}
+
+	*oldbreak = as->as_heaptop;
+	as->as_heaptop = newtop;
+	return 0;
+}
+
+int
+as_copy(struct addrspace *old, struct addrspace **ret)
+{
+	struct addrspace *new;
+
+	new = as_create();
+	if (new==NULL) {
+		return ENOMEM;
+	}
+
+	new->as_vbase1 = old->as_vbase1;
+	new->as_npages1 = old->as_npages1;
+	new->as_vbase2 = old->as_vbase2;
+	new->as_npages2 = old->as_npages2;
+	new->as_writeable1 = old->as_writeable1;
+	new->as_writeable2 = old->as_writeable2;
+	new->as_heapbase = old->as_heapbase;
+	new->as_heaptop = old->as_heaptop;
+
+	/* Text is shared, published or not. */
+	if (old->as_text1 != NULL) {
+		text_ref(old->as_text1);
+		new->as_text1 = old->as_text1;
+	}
+	if (old->as_text2 != NULL) {
+		text_ref(old->as_text2);
+		new->as_text2 = old->as_text2;
+	}
+
+	/* The child still has to load whatever the parent hasn't. */
+	if (old->as_load1 != NULL) {
+		new->as_load1 = segload_copy(old->as_load1);
+		if (new->as_load1 == NULL) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+	}
+	if (old->as_load2 != NULL) {
+		new->as_load2 = segload_copy(old->as_load2);
+		if (new->as_load2 == NULL) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+	}
+
+	if (pt_copy(old, new) || mmap_copy(old, new)) {
+		as_destroy(new);
+		return ENOMEM;
+	}
+
+	*ret = new;
+	return 0;
+}
+
+#endif /* OPT_A3 */
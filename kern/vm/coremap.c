@@ -0,0 +1,407 @@
+/*
+ * Physical memory: the coremap and the pool of zeroed pages. See
+ * vmprivate.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <swap.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * Coremap: one entry per physical page left over after boot. An
+ * allocation is a run of contiguous pages (only big kmallocs want more
+ * than one); the first entry of a run records its length so
+ * free_ppages knows how much to give back. Pages stolen with
+ * ram_stealmem before vm_bootstrap are not in the coremap and are
+ * never freed.
+ *
+ * Single pages, which is nearly everything, come off a free list
+ * threaded through the coremap. A multi-page run is found by a
+ * first-fit scan and leaves its pages on the list, so popping skips
+ * pages that turn out to be in use; every free page is always on it.
+ */
+#define CM_NONE		((unsigned)-1)	/* end of coremap_freelist */
+
+struct coremap_entry *coremap;
+unsigned coremap_npages;
+paddr_t coremap_base;
+struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+
+static unsigned coremap_nfree;		/* pages not in use */
+static unsigned coremap_freelist;	/* first free page, or CM_NONE */
+static bool coremap_ready = false;
+
+/*
+ * Wrap rma_stealmem in a spinlock.
+ */
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Zeroed pages. The pagezero thread runs at the lowest priority, so
+ * only when a cpu has nothing better to do, and keeps up to ZP_TARGET
+ * free pages zeroed in zeropool. Pages in the pool are marked used in
+ * the coremap but are given back as soon as anything else runs short.
+ * Zero-fill faults on the heap and on anonymous mappings take their
+ * pages from the pool, so they usually have nothing to zero.
+ *
+ * zero_page is a page of zeros that is never written. A read fault on
+ * a private page that has never been touched maps it read-only, and
+ * the page gets a frame of its own only when it is first written.
+ */
+#define ZP_TARGET	64		/* pages to keep zeroed */
+#define ZP_LOW		(ZP_TARGET / 2)	/* wake pagezero below this */
+#define ZP_RESERVE	32		/* don't take the last free pages */
+
+paddr_t zero_page;
+
+static paddr_t zeropool[ZP_TARGET];
+static unsigned zeropool_count;		/* protected by coremap_lock */
+static bool pagezero_asleep;		/* protected by coremap_lock */
+static struct semaphore *pagezero_sem;
+
+static void coremap_pushfree(unsigned i);
+static paddr_t coremap_alloc(unsigned long npages);
+static void pagezero_thread(void *unused1, unsigned long unused2);
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t lo, hi;
+	size_t size;
+	unsigned i;
+
+	/* The coremap itself goes at the bottom of the remaining RAM. */
+	ram_getsize(&lo, &hi);
+	coremap = (struct coremap_entry *)PADDR_TO_KVADDR(lo);
+	size = (hi - lo) / PAGE_SIZE * sizeof(struct coremap_entry);
+	lo += ROUNDUP(size, PAGE_SIZE);
+
+	coremap_base = lo;
+	coremap_npages = (hi - lo) / PAGE_SIZE;
+	for (i=0; i<coremap_npages; i++) {
+		coremap[i].cme_used = 0;
+		coremap[i].cme_pageable = 0;
+		coremap[i].cme_ref = 0;
+		coremap[i].cme_clean = 0;
+		coremap[i].cme_onfree = 0;
+		coremap[i].cme_npages = 0;
+		coremap[i].cme_as = NULL;
+		coremap[i].cme_vaddr = 0;
+		coremap[i].cme_slot = 0;
+		coremap[i].cme_lastuse = 0;
+	}
+	/* Lowest pages first */
+	coremap_freelist = CM_NONE;
+	for (i=coremap_npages; i-- > 0; ) {
+		coremap_pushfree(i);
+	}
+	coremap_nfree = coremap_npages;
+	coremap_ready = true;
+
+	zero_page = coremap_alloc(1);
+	pagezero_sem = sem_create("pagezero", 0);
+	if (zero_page == 0 || pagezero_sem == NULL) {
+		panic("vm_bootstrap: out of memory\n");
+	}
+	bzero((void *)PADDR_TO_KVADDR(zero_page), PAGE_SIZE);
+	if (thread_fork("pagezero", NULL, pagezero_thread, NULL, 0)) {
+		panic("vm_bootstrap: cannot start pagezero\n");
+	}
+}
+
+/*
+ * Whether pagezero should be woken to refill the pool; if so, the
+ * caller must V pagezero_sem. Caller holds coremap_lock.
+ */
+static
+bool
+pagezero_wanted(void)
+{
+	if (pagezero_asleep && zeropool_count < ZP_LOW &&
+	    coremap_nfree > ZP_RESERVE) {
+		pagezero_asleep = false;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Put page I on the free list, unless it's still there. Caller holds
+ * coremap_lock.
+ */
+static
+void
+coremap_pushfree(unsigned i)
+{
+	if (!coremap[i].cme_onfree) {
+		coremap[i].cme_onfree = 1;
+		coremap[i].cme_nextfree = coremap_freelist;
+		coremap_freelist = i;
+	}
+}
+
+/*
+ * Find NPAGES free contiguous pages in the coremap: off the free list
+ * for one page, first fit for more.
+ */
+static
+paddr_t
+coremap_alloc(unsigned long npages)
+{
+	unsigned i, j, run;
+
+	spinlock_acquire(&coremap_lock);
+	if (npages == 1) {
+		while (coremap_freelist != CM_NONE) {
+			i = coremap_freelist;
+			coremap_freelist = coremap[i].cme_nextfree;
+			coremap[i].cme_onfree = 0;
+			if (coremap[i].cme_used) {
+				/* taken by a multi-page run */
+				continue;
+			}
+			coremap[i].cme_used = 1;
+			coremap[i].cme_npages = 1;
+			coremap_nfree--;
+			spinlock_release(&coremap_lock);
+			return coremap_base + i * PAGE_SIZE;
+		}
+		spinlock_release(&coremap_lock);
+		return 0;
+	}
+	run = 0;
+	for (i=0; i<coremap_npages; i++) {
+		if (coremap[i].cme_used) {
+			run = 0;
+			continue;
+		}
+		if (++run < npages) {
+			continue;
+		}
+		i = i + 1 - npages;
+		for (j=0; j<npages; j++) {
+			coremap[i+j].cme_used = 1;
+		}
+		coremap[i].cme_npages = npages;
+		coremap_nfree -= npages;
+		spinlock_release(&coremap_lock);
+		return coremap_base + i * PAGE_SIZE;
+	}
+	spinlock_release(&coremap_lock);
+	return 0;
+}
+
+/*
+ * Free a run of pages from getppages.
+ */
+void
+free_ppages(paddr_t paddr)
+{
+	unsigned i, j, npages, slot;
+	bool wake, clean;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+	if (!coremap_ready || paddr < coremap_base) {
+		/* stolen before the coremap existed - leak it */
+		return;
+	}
+
+	i = (paddr - coremap_base) / PAGE_SIZE;
+	KASSERT(i < coremap_npages);
+	KASSERT(paddr != zero_page);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].cme_used);
+	npages = coremap[i].cme_npages;
+	KASSERT(npages > 0 && i + npages <= coremap_npages);
+	clean = coremap[i].cme_clean;
+	slot = coremap[i].cme_slot;
+	if (coremap[i].cme_pageable) {
+		coremap[i].cme_as->as_rss--;
+	}
+	for (j=0; j<npages; j++) {
+		coremap[i+j].cme_used = 0;
+		coremap[i+j].cme_pageable = 0;
+		coremap[i+j].cme_ref = 0;
+		coremap[i+j].cme_clean = 0;
+		coremap[i+j].cme_npages = 0;
+		coremap[i+j].cme_as = NULL;
+		coremap_pushfree(i+j);
+	}
+	coremap_nfree += npages;
+	wake = pagezero_wanted();
+	spinlock_release(&coremap_lock);
+
+	if (clean) {
+		/* the swap copy of a page being thrown away */
+		swap_free(slot);
+	}
+	if (wake) {
+		V(pagezero_sem);
+	}
+}
+
+/*
+ * Give all the pre-zeroed pages back, for an allocation that
+ * couldn't be satisfied without them.
+ */
+static
+bool
+zeropool_drain(void)
+{
+	paddr_t paddr;
+	bool any = false;
+
+	while (1) {
+		spinlock_acquire(&coremap_lock);
+		if (zeropool_count == 0) {
+			spinlock_release(&coremap_lock);
+			return any;
+		}
+		paddr = zeropool[--zeropool_count];
+		spinlock_release(&coremap_lock);
+		free_ppages(paddr);
+		any = true;
+	}
+}
+
+/*
+ * Pages that can be had for the asking.
+ */
+unsigned
+coremap_avail(void)
+{
+	return coremap_nfree + zeropool_count;
+}
+
+struct coremap_entry *
+coremap_entry(paddr_t paddr)
+{
+	KASSERT(paddr >= coremap_base);
+	KASSERT((paddr - coremap_base) / PAGE_SIZE < coremap_npages);
+	return &coremap[(paddr - coremap_base) / PAGE_SIZE];
+}
+
+/*
+ * Keep the pool topped up. Sleeps when the pool is full or memory is
+ * short, and is woken by getzeropage and free_ppages.
+ */
+static
+void
+pagezero_thread(void *unused1, unsigned long unused2)
+{
+	paddr_t paddr;
+	bool full;
+
+	(void)unused1;
+	(void)unused2;
+
+	thread_setpriority(PRI_MIN);
+	while (1) {
+		spinlock_acquire(&coremap_lock);
+		if (zeropool_count >= ZP_TARGET ||
+		    coremap_nfree <= ZP_RESERVE) {
+			pagezero_asleep = true;
+			spinlock_release(&coremap_lock);
+			P(pagezero_sem);
+			continue;
+		}
+		spinlock_release(&coremap_lock);
+
+		paddr = coremap_alloc(1);
+		if (paddr == 0) {
+			continue;
+		}
+		bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+
+		spinlock_acquire(&coremap_lock);
+		full = (zeropool_count >= ZP_TARGET);
+		if (!full) {
+			zeropool[zeropool_count++] = paddr;
+		}
+		spinlock_release(&coremap_lock);
+		if (full) {
+			free_ppages(paddr);
+		}
+	}
+}
+
+paddr_t
+getppages(unsigned long npages)
+{
+	paddr_t addr;
+
+	if (coremap_ready) {
+		addr = coremap_alloc(npages);
+		if (addr == 0 && zeropool_drain()) {
+			addr = coremap_alloc(npages);
+		}
+		return addr;
+	}
+
+	spinlock_acquire(&stealmem_lock);
+
+	addr = ram_stealmem(npages);
+
+	spinlock_release(&stealmem_lock);
+	return addr;
+}
+
+/*
+ * Get a page of zeros: from the pool if there is one, otherwise
+ * allocate one and zero it here. Caller holds mm_lock.
+ */
+paddr_t
+getzeropage(void)
+{
+	paddr_t paddr = 0;
+	bool wake;
+
+	spinlock_acquire(&coremap_lock);
+	if (zeropool_count > 0) {
+		paddr = zeropool[--zeropool_count];
+	}
+	wake = pagezero_wanted();
+	spinlock_release(&coremap_lock);
+
+	if (wake) {
+		V(pagezero_sem);
+	}
+	if (paddr == 0) {
+		paddr = getuserpages(1);
+		if (paddr != 0) {
+			bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+		}
+	}
+	return paddr;
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(int npages)
+{
+	paddr_t pa;
+	pa = getppages(npages);
+	if (pa==0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	KASSERT(addr >= MIPS_KSEG0);
+	free_ppages(addr - MIPS_KSEG0);
+}
+
+#endif /* OPT_A3 */
@@ -0,0 +1,745 @@
+/*
+ * Memory-mapped files and anonymous memory. See vmprivate.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <uio.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * A mapping (struct mmregion) is a run of pages in an address space
+ * backed by part of a memory object (struct mmobj), an array of page
+ * table entries that are filled in on first touch by reading the
+ * object's file or by zeroing. A written page is marked PTE_DIRTY.
+ *
+ * A private mapping has an object of its own. All MAP_SHARED mappings
+ * of a file use the one object for that file, found on mmobjs, so
+ * every process sees the same pages. A shared anonymous object is
+ * shared only with the children it is forked to.
+ *
+ * Dirty pages of a shared file object are written back on munmap, on
+ * fsync, and when the last mapping goes away. Each object keeps a list
+ * of the mappings of it, so writing back can clean a page: it is made
+ * read-only in every address space that maps it, shooting it down
+ * from other cpus' TLBs, before it's written, and the next write to it
+ * marks it dirty again.
+ *
+ * Mappings are placed downwards from just below the stack, and the
+ * heap can't grow past the lowest one. mm_lock protects all objects,
+ * their frames and their lists of mappings.
+ */
+static struct mmobj *mmobjs;
+
+/*
+ * Make sure the page entry array *PAGESP, of length *MAXP, has room
+ * for NPAGES pages. New entries are 0.
+ */
+static
+int
+pages_reserve(pte_t **pagesp, unsigned *maxp, unsigned npages)
+{
+	pte_t *pages;
+	unsigned max;
+
+	if (npages <= *maxp) {
+		return 0;
+	}
+	max = *maxp * 2;
+	if (max < 16) {
+		max = 16;
+	}
+	if (max < npages) {
+		max = npages;
+	}
+	pages = kmalloc(max * sizeof(pte_t));
+	if (pages == NULL) {
+		return ENOMEM;
+	}
+	bzero(pages, max * sizeof(pte_t));
+	if (*pagesp != NULL) {
+		memcpy(pages, *pagesp, *maxp * sizeof(pte_t));
+		kfree(*pagesp);
+	}
+	*pagesp = pages;
+	*maxp = max;
+	return 0;
+}
+
+/*
+ * Memory object operations. Caller holds mm_lock for all but
+ * mmobj_create.
+ *
+ * mm_lock is let go while reading and writing files: the file system
+ * may be holding its own locks while it copies to a user buffer and
+ * takes a fault that needs mm_lock.
+ */
+static
+struct mmobj *
+mmobj_create(struct vnode *v, off_t offset, bool shared)
+{
+	struct mmobj *mo;
+
+	mo = kmalloc(sizeof(*mo));
+	if (mo == NULL) {
+		return NULL;
+	}
+	if (v != NULL) {
+		VOP_INCREF(v);
+	}
+	mo->mo_vnode = v;
+	mo->mo_offset = offset;
+	mo->mo_shared = shared;
+	mo->mo_refcount = 1;
+	mo->mo_npages = 0;
+	mo->mo_pages = NULL;
+	mo->mo_maps = NULL;
+	mo->mo_next = NULL;
+	return mo;
+}
+
+/*
+ * Add MR, a mapping in AS, to its object's list of mappings, or take
+ * it off.
+ */
+static
+void
+mmobj_attach(struct mmregion *mr, struct addrspace *as)
+{
+	KASSERT(lock_do_i_hold(mm_lock));
+	mr->mr_as = as;
+	mr->mr_objnext = mr->mr_obj->mo_maps;
+	mr->mr_obj->mo_maps = mr;
+}
+
+static
+void
+mmobj_detach(struct mmregion *mr)
+{
+	struct mmregion **mrp;
+
+	KASSERT(lock_do_i_hold(mm_lock));
+	for (mrp = &mr->mr_obj->mo_maps; *mrp != mr;
+	     mrp = &(*mrp)->mr_objnext) {
+		KASSERT(*mrp != NULL);
+	}
+	*mrp = mr->mr_objnext;
+	mr->mr_objnext = NULL;
+}
+
+/*
+ * Make page INDEX of an object read-only everywhere it is mapped, so
+ * that the next write to it faults. Other cpus are added to SB.
+ */
+static
+void
+mmobj_protect(struct mmobj *mo, unsigned index, struct shootbatch *sb)
+{
+	struct mmregion *mr;
+
+	for (mr = mo->mo_maps; mr != NULL; mr = mr->mr_objnext) {
+		if (index < mr->mr_objpage ||
+		    index >= mr->mr_objpage + mr->mr_npages) {
+			continue;
+		}
+		shoot_page(sb, mr->mr_as, mr->mr_vbase +
+			   (index - mr->mr_objpage) * PAGE_SIZE);
+	}
+}
+
+/*
+ * Write back the dirty pages FROM..TO-1 of a shared file object, and
+ * mark them clean. The file isn't extended: the part of a page past
+ * end of file is not written. The caller must have a reference to the
+ * object, so its frames stay put while mm_lock is let go.
+ *
+ * Pages go WB_BATCH at a time: each batch is cleaned and made
+ * read-only everywhere, with one shootdown, before any of it is
+ * written, so a write made meanwhile marks the page dirty again. If a
+ * write fails, the pages not yet written are marked dirty again.
+ */
+#define WB_BATCH	16
+
+static
+int
+mmobj_writeback(struct mmobj *mo, unsigned from, unsigned to)
+{
+	unsigned batch[WB_BATCH];
+	struct shootbatch sb;
+	struct iovec iov;
+	struct uio ku;
+	struct stat st;
+	off_t pos;
+	size_t len;
+	unsigned i, j, n;
+	int result;
+
+	if (!mo->mo_shared || mo->mo_vnode == NULL) {
+		return 0;
+	}
+	result = VOP_STAT(mo->mo_vnode, &st);
+	if (result) {
+		return result;
+	}
+	if (to > mo->mo_npages) {
+		to = mo->mo_npages;
+	}
+	if (mo->mo_offset >= st.st_size) {
+		return 0;
+	}
+	if (mo->mo_offset + (off_t)to * PAGE_SIZE > st.st_size) {
+		to = (st.st_size - mo->mo_offset + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+
+	shoot_init(&sb);
+	i = from;
+	while (i < to) {
+		n = 0;
+		for (; i < to && n < WB_BATCH; i++) {
+			if (mo->mo_pages[i] & PTE_DIRTY) {
+				mo->mo_pages[i] &= ~PTE_DIRTY;
+				mmobj_protect(mo, i, &sb);
+				batch[n++] = i;
+			}
+		}
+		shoot_flush(&sb);
+
+		for (j=0; j<n; j++) {
+			pos = mo->mo_offset + (off_t)batch[j] * PAGE_SIZE;
+			len = PAGE_SIZE;
+			if (pos + len > st.st_size) {
+				len = st.st_size - pos;
+			}
+			uio_kinit(&iov, &ku,
+				  (void *)PADDR_TO_KVADDR(mo->mo_pages[batch[j]] &
+							  PTE_FRAME),
+				  len, pos, UIO_WRITE);
+			lock_release(mm_lock);
+			result = VOP_WRITE(mo->mo_vnode, &ku);
+			lock_acquire(mm_lock);
+			if (result) {
+				for (; j<n; j++) {
+					mo->mo_pages[batch[j]] |= PTE_DIRTY;
+				}
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+static
+void
+mmobj_release(struct mmobj *mo)
+{
+	struct mmobj **mop;
+	unsigned i;
+
+	KASSERT(mo->mo_refcount > 0);
+	mo->mo_refcount--;
+	if (mo->mo_refcount > 0) {
+		return;
+	}
+
+	/* Unlist it first, so nobody picks it up during the writeback. */
+	for (mop = &mmobjs; *mop != NULL; mop = &(*mop)->mo_next) {
+		if (*mop == mo) {
+			*mop = mo->mo_next;
+			break;
+		}
+	}
+	if (mmobj_writeback(mo, 0, mo->mo_npages)) {
+		kprintf("mmap: lost changes to a mapped file\n");
+	}
+	for (i=0; i<mo->mo_npages; i++) {
+		page_discard(&mo->mo_pages[i]);
+	}
+	if (mo->mo_vnode != NULL) {
+		VOP_DECREF(mo->mo_vnode);
+	}
+	if (mo->mo_pages != NULL) {
+		kfree(mo->mo_pages);
+	}
+	kfree(mo);
+}
+
+/*
+ * Find or fill in page INDEX of an object, mapped at VADDR in AS. A
+ * file page is read from the file; the part of it (if any) past end of
+ * file is zeroed. A private object's page may have to come back from
+ * swap.
+ */
+static
+int
+mmobj_page(struct mmobj *mo, unsigned index, struct addrspace *as,
+	   vaddr_t vaddr, paddr_t *ret)
+{
+	struct iovec iov;
+	struct uio ku;
+	paddr_t paddr;
+	char *kva;
+	int result;
+
+	KASSERT(index < mo->mo_npages);
+	if (mo->mo_pages[index] & PTE_SWAPPED) {
+		KASSERT(!mo->mo_shared);
+		result = page_swapin(as, vaddr, &mo->mo_pages[index]);
+		if (result) {
+			return result;
+		}
+	}
+	if (mo->mo_pages[index] != 0) {
+		*ret = mo->mo_pages[index] & PTE_FRAME;
+		return 0;
+	}
+
+	if (mo->mo_vnode == NULL) {
+		paddr = getzeropage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		vm_pagein(false);
+	}
+	else {
+		paddr = getuserpages(1);
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		kva = (char *)PADDR_TO_KVADDR(paddr);
+		uio_kinit(&iov, &ku, kva, PAGE_SIZE,
+			  mo->mo_offset + (off_t)index * PAGE_SIZE, UIO_READ);
+		lock_release(mm_lock);
+		result = VOP_READ(mo->mo_vnode, &ku);
+		lock_acquire(mm_lock);
+		if (result) {
+			free_ppages(paddr);
+			return result;
+		}
+		if (mo->mo_pages[index] != 0) {
+			/* another user of a shared object beat us to it */
+			free_ppages(paddr);
+			*ret = mo->mo_pages[index] & PTE_FRAME;
+			return 0;
+		}
+		bzero(kva + PAGE_SIZE - ku.uio_resid, ku.uio_resid);
+		vm_pagein(true);
+	}
+	mo->mo_pages[index] = paddr | PTE_VALID;
+	if (!mo->mo_shared) {
+		page_setowner(paddr, as, vaddr, false, 0);
+	}
+	*ret = paddr;
+	return 0;
+}
+
+/*
+ * The mapping containing VADDR, or NULL.
+ */
+struct mmregion *
+mmap_find(struct addrspace *as, vaddr_t vaddr)
+{
+	struct mmregion *mr;
+
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (vaddr >= mr->mr_vbase &&
+		    vaddr < mr->mr_vbase + mr->mr_npages * PAGE_SIZE) {
+			return mr;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * The lowest address used by mappings; the heap stops here.
+ */
+vaddr_t
+mmap_floor(struct addrspace *as)
+{
+	struct mmregion *mr;
+	vaddr_t floor;
+
+	floor = VM_STACKBASE;
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		floor = mr->mr_vbase;
+	}
+	return floor;
+}
+
+/*
+ * Handle a fault on a mapped page. Pages of a writeable shared file
+ * mapping are mapped read-only until they are written, so we know
+ * which ones to write back. As in pte_fault, the TLB is loaded with
+ * mm_lock held.
+ */
+int
+mmap_fault(struct addrspace *as, struct mmregion *mr, int faulttype,
+	   vaddr_t vaddr)
+{
+	struct mmobj *mo = mr->mr_obj;
+	unsigned index;
+	paddr_t paddr;
+	bool writeable;
+	int result;
+
+	if ((mr->mr_prot & (PROT_READ | PROT_WRITE | PROT_EXEC)) == 0) {
+		return EFAULT;
+	}
+	if (faulttype != VM_FAULT_READ && (mr->mr_prot & PROT_WRITE) == 0) {
+		return EFAULT;
+	}
+
+	index = mr->mr_objpage + (vaddr - mr->mr_vbase) / PAGE_SIZE;
+	lock_acquire(mm_lock);
+	if (!mo->mo_shared) {
+		vm_loadcontrol(as);
+	}
+	if (faulttype == VM_FAULT_READ && !mo->mo_shared &&
+	    mo->mo_vnode == NULL && mo->mo_pages[index] == 0) {
+		/* Private and untouched: it's all zeros. */
+		tlb_load(as, vaddr, zero_page, false);
+		lock_release(mm_lock);
+		return 0;
+	}
+	result = mmobj_page(mo, index, as, vaddr, &paddr);
+	if (result) {
+		lock_release(mm_lock);
+		return result;
+	}
+	if (faulttype != VM_FAULT_READ) {
+		mo->mo_pages[index] |= PTE_DIRTY;
+	}
+	writeable = (mr->mr_prot & PROT_WRITE) != 0 &&
+		((mo->mo_pages[index] & PTE_DIRTY) != 0 ||
+		 !mo->mo_shared || mo->mo_vnode == NULL);
+	if (!mo->mo_shared) {
+		page_use(paddr, faulttype, &writeable);
+	}
+	tlb_load(as, vaddr, paddr, writeable);
+	lock_release(mm_lock);
+	return 0;
+}
+
+/*
+ * Throw out NPAGES pages of a mapping, starting at VADDR, which is
+ * page INDEX of its object. Shared pages are written back, and stay
+ * in the object for its other users; private ones are freed. Caller
+ * holds mm_lock.
+ */
+static
+void
+mmap_unmap_pages(struct addrspace *as, struct mmobj *mo, vaddr_t vaddr,
+		 unsigned index, unsigned npages)
+{
+	unsigned i;
+
+	if (mo->mo_shared) {
+		if (mmobj_writeback(mo, index, index + npages)) {
+			kprintf("mmap: lost changes to a mapped file\n");
+		}
+	}
+	swtlb_flush(as);
+	if (as == curproc_getas()) {
+		tlb_unmap(vaddr, vaddr + npages * PAGE_SIZE);
+	}
+	if (!mo->mo_shared) {
+		for (i=0; i<npages; i++) {
+			page_discard(&mo->mo_pages[index + i]);
+		}
+	}
+}
+
+int
+as_mmap(struct addrspace *as, vaddr_t addr, size_t len, int prot, int flags,
+	struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	struct mmregion *mr, **mrp;
+	struct mmobj *mo;
+	vaddr_t vbase, top, bottom;
+	size_t size;
+	unsigned npages, objpage;
+	int result;
+
+	if (len == 0 || len > USERSTACK) {
+		return EINVAL;
+	}
+	size = ROUNDUP(len, PAGE_SIZE);
+	npages = size / PAGE_SIZE;
+	top = VM_STACKBASE;
+	bottom = ROUNDUP(as->as_heaptop, PAGE_SIZE);
+
+	/* Pick a spot: the highest gap that fits. */
+	if (flags & MAP_FIXED) {
+		vbase = addr;
+		if ((vbase & PAGE_FRAME) != vbase || vbase < bottom ||
+		    vbase > top || size > top - vbase) {
+			return EINVAL;
+		}
+		for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+			if (vbase < mr->mr_vbase + mr->mr_npages * PAGE_SIZE &&
+			    mr->mr_vbase < vbase + size) {
+				return EINVAL;
+			}
+		}
+	}
+	else {
+		for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+			if (top - (mr->mr_vbase + mr->mr_npages * PAGE_SIZE)
+			    >= size) {
+				break;
+			}
+			top = mr->mr_vbase;
+		}
+		if (top < bottom || top - bottom < size) {
+			return ENOMEM;
+		}
+		vbase = top - size;
+	}
+
+	mr = kmalloc(sizeof(*mr));
+	if (mr == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(mm_lock);
+	if (v != NULL && (flags & MAP_SHARED)) {
+		/* Everyone sharing a file shares one object for it. */
+		for (mo = mmobjs; mo != NULL; mo = mo->mo_next) {
+			if (mo->mo_vnode == v) {
+				break;
+			}
+		}
+		if (mo != NULL) {
+			mo->mo_refcount++;
+		}
+		else {
+			mo = mmobj_create(v, 0, true);
+			if (mo != NULL) {
+				mo->mo_next = mmobjs;
+				mmobjs = mo;
+			}
+		}
+		objpage = offset / PAGE_SIZE;
+	}
+	else {
+		mo = mmobj_create(v, offset, (flags & MAP_SHARED) != 0);
+		objpage = 0;
+	}
+	if (mo == NULL) {
+		lock_release(mm_lock);
+		kfree(mr);
+		return ENOMEM;
+	}
+	result = pages_reserve(&mo->mo_pages, &mo->mo_npages,
+				objpage + npages);
+	if (result) {
+		mmobj_release(mo);
+		lock_release(mm_lock);
+		kfree(mr);
+		return result;
+	}
+
+	mr->mr_vbase = vbase;
+	mr->mr_npages = npages;
+	mr->mr_prot = prot;
+	mr->mr_obj = mo;
+	mr->mr_objpage = objpage;
+	mmobj_attach(mr, as);
+
+	/* Keep the list in descending order of address. */
+	for (mrp = &as->as_mmaps; *mrp != NULL; mrp = &(*mrp)->mr_next) {
+		if ((*mrp)->mr_vbase < vbase) {
+			break;
+		}
+	}
+	mr->mr_next = *mrp;
+	*mrp = mr;
+	lock_release(mm_lock);
+
+	*ret = vbase;
+	return 0;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct mmregion *mr, *tail, **mrp;
+	vaddr_t end, mrend, start, stop;
+	unsigned n;
+
+	if ((addr & PAGE_FRAME) != addr || len == 0 ||
+	    len > USERSTACK - addr) {
+		return EINVAL;
+	}
+	end = addr + ROUNDUP(len, PAGE_SIZE);
+
+	lock_acquire(mm_lock);
+	mrp = &as->as_mmaps;
+	while ((mr = *mrp) != NULL) {
+		mrend = mr->mr_vbase + mr->mr_npages * PAGE_SIZE;
+		if (mrend <= addr || mr->mr_vbase >= end) {
+			mrp = &mr->mr_next;
+			continue;
+		}
+		start = addr > mr->mr_vbase ? addr : mr->mr_vbase;
+		stop = end < mrend ? end : mrend;
+		n = (stop - start) / PAGE_SIZE;
+
+		if (start > mr->mr_vbase && stop < mrend) {
+			/* A hole in the middle: split off the top part. */
+			tail = kmalloc(sizeof(*tail));
+			if (tail == NULL) {
+				lock_release(mm_lock);
+				return ENOMEM;
+			}
+			tail->mr_vbase = stop;
+			tail->mr_npages = (mrend - stop) / PAGE_SIZE;
+			tail->mr_prot = mr->mr_prot;
+			tail->mr_obj = mr->mr_obj;
+			tail->mr_objpage = mr->mr_objpage +
+				(stop - mr->mr_vbase) / PAGE_SIZE;
+			tail->mr_next = mr;
+			mr->mr_obj->mo_refcount++;
+			mmobj_attach(tail, as);
+			*mrp = tail;
+			mrp = &tail->mr_next;
+		}
+
+		mmap_unmap_pages(as, mr->mr_obj, start, mr->mr_objpage +
+				 (start - mr->mr_vbase) / PAGE_SIZE, n);
+
+		if (start == mr->mr_vbase && stop == mrend) {
+			*mrp = mr->mr_next;
+			mmobj_detach(mr);
+			mmobj_release(mr->mr_obj);
+			kfree(mr);
+			continue;
+		}
+		if (start == mr->mr_vbase) {
+			mr->mr_vbase = stop;
+			mr->mr_objpage += n;
+			mr->mr_npages -= n;
+		}
+		else {
+			mr->mr_npages = (start - mr->mr_vbase) / PAGE_SIZE;
+		}
+		mrp = &mr->mr_next;
+	}
+	lock_release(mm_lock);
+	return 0;
+}
+
+void
+mmap_fsync(struct vnode *v)
+{
+	struct mmobj *mo;
+
+	lock_acquire(mm_lock);
+	for (mo = mmobjs; mo != NULL; mo = mo->mo_next) {
+		if (mo->mo_vnode == v) {
+			mo->mo_refcount++;
+			if (mmobj_writeback(mo, 0, mo->mo_npages)) {
+				kprintf("mmap: lost changes to a mapped file\n");
+			}
+			mmobj_release(mo);
+			break;
+		}
+	}
+	lock_release(mm_lock);
+}
+
+/*
+ * Drop all of an address space's mappings.
+ */
+void
+mmap_destroy(struct addrspace *as)
+{
+	struct mmregion *mr;
+
+	lock_acquire(mm_lock);
+	while ((mr = as->as_mmaps) != NULL) {
+		as->as_mmaps = mr->mr_next;
+		mmobj_detach(mr);
+		mmobj_release(mr->mr_obj);
+		kfree(mr);
+	}
+	lock_release(mm_lock);
+}
+
+/*
+ * Copy the mappings for fork. Shared objects are shared with the
+ * child; private ones are copied, but only the pages in use.
+ */
+int
+mmap_copy(struct addrspace *old, struct addrspace *new)
+{
+	struct mmregion *mr, *nmr, **tailp;
+	struct mmobj *mo;
+	unsigned i;
+	pte_t *from;
+
+	tailp = &new->as_mmaps;
+	lock_acquire(mm_lock);
+	for (mr = old->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		nmr = kmalloc(sizeof(*nmr));
+		if (nmr == NULL) {
+			goto fail;
+		}
+		*nmr = *mr;
+		nmr->mr_next = NULL;
+
+		if (mr->mr_obj->mo_shared) {
+			mr->mr_obj->mo_refcount++;
+			mmobj_attach(nmr, new);
+			*tailp = nmr;
+			tailp = &nmr->mr_next;
+			continue;
+		}
+
+		mo = mmobj_create(mr->mr_obj->mo_vnode, mr->mr_obj->mo_offset +
+				  (off_t)mr->mr_objpage * PAGE_SIZE, false);
+		if (mo == NULL) {
+			kfree(nmr);
+			goto fail;
+		}
+		nmr->mr_obj = mo;
+		nmr->mr_objpage = 0;
+		mmobj_attach(nmr, new);
+		*tailp = nmr;
+		tailp = &nmr->mr_next;
+		if (pages_reserve(&mo->mo_pages, &mo->mo_npages,
+				   mr->mr_npages)) {
+			goto fail;
+		}
+		for (i=0; i<mr->mr_npages; i++) {
+			from = &mr->mr_obj->mo_pages[mr->mr_objpage + i];
+			if (*from == 0) {
+				continue;
+			}
+			if (page_copy(from, new, nmr->mr_vbase + i * PAGE_SIZE,
+				      &mo->mo_pages[i])) {
+				goto fail;
+			}
+		}
+	}
+	lock_release(mm_lock);
+	return 0;
+
+ fail:
+	/* as_destroy cleans up what we got done */
+	lock_release(mm_lock);
+	return ENOMEM;
+}
+
+#endif /* OPT_A3 */
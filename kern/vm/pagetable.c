@@ -0,0 +1,120 @@
+/*
+ * Two-level page tables. See pagetable.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <vm.h>
+#include <pagetable.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+#define PT_NDIR		(USERSPACETOP / PT_SPAN)
+
+#define PT_DIRINDEX(va)	((va) / PT_SPAN)
+#define PT_INDEX(va)	(((va) / PAGE_SIZE) % PT_NPTES)
+
+struct pagetable {
+	pte_t *pt_dir[PT_NDIR];
+};
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+	unsigned i;
+
+	pt = kmalloc(sizeof(*pt));
+	if (pt == NULL) {
+		return NULL;
+	}
+	for (i=0; i<PT_NDIR; i++) {
+		pt->pt_dir[i] = NULL;
+	}
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i;
+
+	for (i=0; i<PT_NDIR; i++) {
+		if (pt->pt_dir[i] != NULL) {
+			kfree(pt->pt_dir[i]);
+		}
+	}
+	kfree(pt);
+}
+
+pte_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr)
+{
+	pte_t *table;
+
+	if (vaddr >= USERSPACETOP) {
+		return NULL;
+	}
+	table = pt->pt_dir[PT_DIRINDEX(vaddr)];
+	if (table == NULL) {
+		return NULL;
+	}
+	return &table[PT_INDEX(vaddr)];
+}
+
+pte_t *
+pt_alloc(struct pagetable *pt, vaddr_t vaddr)
+{
+	pte_t *table;
+
+	KASSERT(vaddr < USERSPACETOP);
+	table = pt->pt_dir[PT_DIRINDEX(vaddr)];
+	if (table == NULL) {
+		table = kmalloc(PT_NPTES * sizeof(pte_t));
+		if (table == NULL) {
+			return NULL;
+		}
+		bzero(table, PT_NPTES * sizeof(pte_t));
+		pt->pt_dir[PT_DIRINDEX(vaddr)] = table;
+	}
+	return &table[PT_INDEX(vaddr)];
+}
+
+int
+pt_foreach(struct pagetable *pt, vaddr_t start, vaddr_t end,
+	   int (*func)(void *data, vaddr_t vaddr, pte_t *pte),
+	   void *data)
+{
+	pte_t *table;
+	vaddr_t va, next;
+	int result;
+
+	if (end > USERSPACETOP) {
+		end = USERSPACETOP;
+	}
+	for (va = start & PAGE_FRAME; va < end; va = next) {
+		/* the start of the next table, taking care not to wrap */
+		next = (va - va % PT_SPAN) + PT_SPAN;
+		if (next > end || next < va) {
+			next = end;
+		}
+		table = pt->pt_dir[PT_DIRINDEX(va)];
+		if (table == NULL) {
+			continue;
+		}
+		for (; va < next; va += PAGE_SIZE) {
+			if (table[PT_INDEX(va)] == 0) {
+				continue;
+			}
+			result = func(data, va, &table[PT_INDEX(va)]);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+#endif /* OPT_A3 */
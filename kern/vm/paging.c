@@ -0,0 +1,546 @@
+/*
+ * Paging and load control. See vmprivate.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <clock.h>
+#include <timer.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <swap.h>
+#include <uw-vmstats.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * Every page of an address space except text - writeable program
+ * regions, the stack, the heap, private mappings - has a frame of its
+ * own and can be paged out. The page entry (in the page table, or
+ * mo_pages for a mapping) of a page that is out holds its swap slot,
+ * tagged with PTE_SWAPPED.
+ *
+ * Victims are chosen by WSClock. coremap_hand sweeps the coremap; a
+ * page whose reference bit is set has it cleared and its last-use
+ * time updated, and a page that hasn't been used for longer than its
+ * owner's working-set window is taken. vm_fault sets the bit each time
+ * it loads a TLB entry for a page, and the hand samples pages by
+ * dropping their TLB entries, so their next use is seen. Victims are
+ * gathered SWAP_BATCH at a time and written out together.
+ *
+ * The window is WS_TAU ticks, adjusted by the owner's page-fault rate:
+ * doubled for a process faulting more than PFF_HIGH pages a second,
+ * which needs more memory, and halved for one faulting fewer than
+ * PFF_LOW, which can spare some. If a whole sweep finds nothing outside
+ * a working set, memory is overcommitted: the second sweep takes any
+ * unreferenced page, and for VM_THRASH_TICKS load control suspends the
+ * least important process each time it faults (see vm_loadcontrol).
+ *
+ * A page read back in keeps its slot and is mapped read-only; if it is
+ * chosen again before it's written, it needn't be written again. The
+ * first write to it frees the slot.
+ *
+ * Pages taken or sampled are shot down from every TLB with shoot_page,
+ * a batch at a time, and a batch of victims is always shot down before
+ * it is written out.
+ */
+#define SWAP_BATCH	8		/* pages written out at once */
+#define SWAP_KRESERVE	16		/* free pages left for the kernel */
+
+#define WS_TAU		HZ		/* working-set window, in ticks */
+#define PFF_WINDOW	HZ		/* fault rate is measured over this */
+#define PFF_LOW		4		/* pages/second */
+#define PFF_HIGH	64
+#define VM_THRASH_TICKS	(2 * HZ)	/* load control stays on this long */
+#define VM_SUSPEND_TICKS (HZ / 2)	/* a suspended process sleeps this long */
+
+static unsigned coremap_hand;		/* protected by coremap_lock */
+
+/* Protected by mm_lock */
+static unsigned vm_thrash_until;	/* tick load control stops */
+static struct cv *vm_loadcv;		/* suspended processes sleep here */
+static unsigned vm_evict_ws;		/* pages out from outside working sets */
+static unsigned vm_evict_forced;	/* ...and from inside */
+static unsigned vm_suspends;
+
+void
+paging_bootstrap(void)
+{
+	vm_loadcv = cv_create("vmload");
+	if (vm_loadcv == NULL) {
+		panic("vm_bootstrap: out of memory\n");
+	}
+}
+
+/*
+ * Count a page brought in for the current process: in its rusage, and
+ * towards its address space's fault rate. The rate is worked out over
+ * windows of at least PFF_WINDOW ticks.
+ */
+void
+vm_pagein(bool major)
+{
+	struct addrspace *as;
+	unsigned now, elapsed;
+
+	if (major) {
+		curthread->t_usage.tu_majflt++;
+	}
+	else {
+		curthread->t_usage.tu_minflt++;
+	}
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+	now = timer_ticks();
+	elapsed = now - as->as_pffstart;
+	if (elapsed >= PFF_WINDOW) {
+		as->as_pffrate = as->as_pfffaults * HZ / elapsed;
+		as->as_pfffaults = 0;
+		as->as_pffstart = now;
+	}
+	as->as_pfffaults++;
+	as->as_faults++;
+}
+
+/*
+ * Pages brought in per second, lately. A window that has gone on too
+ * long counts as it stands, so a process that stops faulting is seen
+ * to have stopped.
+ */
+unsigned
+as_faultrate(struct addrspace *as, unsigned now)
+{
+	unsigned elapsed = now - as->as_pffstart;
+
+	if (elapsed >= PFF_WINDOW) {
+		return as->as_pfffaults * HZ / elapsed;
+	}
+	return as->as_pffrate;
+}
+
+/*
+ * How long a page of AS may go unused and still be in its working
+ * set.
+ */
+static
+unsigned
+as_wstau(struct addrspace *as, unsigned now)
+{
+	unsigned rate = as_faultrate(as, now);
+
+	if (rate > PFF_HIGH) {
+		return WS_TAU * 2;
+	}
+	if (rate < PFF_LOW) {
+		return WS_TAU / 2;
+	}
+	return WS_TAU;
+}
+
+/*
+ * Pageable pages of AS in its working set. (Takes coremap_lock; it's
+ * only for reports.)
+ */
+unsigned
+as_wscount(struct addrspace *as, unsigned now)
+{
+	struct coremap_entry *cme;
+	unsigned i, tau, ws = 0;
+
+	tau = as_wstau(as, now);
+	spinlock_acquire(&coremap_lock);
+	for (i=0; i<coremap_npages; i++) {
+		cme = &coremap[i];
+		if (cme->cme_pageable && cme->cme_as == as &&
+		    (cme->cme_ref || now - cme->cme_lastuse <= tau)) {
+			ws++;
+		}
+	}
+	spinlock_release(&coremap_lock);
+	return ws;
+}
+
+/*
+ * Paging operations. Caller holds mm_lock for all of these.
+ */
+
+/*
+ * The page entry for pageable page VADDR of AS: in its page table,
+ * unless the page is mapped.
+ */
+static
+pte_t *
+page_entry(struct addrspace *as, vaddr_t vaddr)
+{
+	struct mmregion *mr;
+	pte_t *pte;
+
+	mr = mmap_find(as, vaddr);
+	if (mr != NULL) {
+		KASSERT(!mr->mr_obj->mo_shared);
+		return &mr->mr_obj->mo_pages[mr->mr_objpage +
+					     (vaddr - mr->mr_vbase) / PAGE_SIZE];
+	}
+	pte = pt_lookup(as->as_pt, vaddr);
+	KASSERT(pte != NULL);
+	return pte;
+}
+
+/*
+ * Make frame PADDR pageable, as page VADDR of AS. If CLEAN, it was
+ * just read from swap slot SLOT, which it keeps.
+ */
+void
+page_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr,
+	      bool clean, unsigned slot)
+{
+	struct coremap_entry *cme = coremap_entry(paddr);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(cme->cme_used && !cme->cme_pageable);
+	cme->cme_pageable = 1;
+	cme->cme_ref = 1;
+	cme->cme_clean = clean;
+	cme->cme_as = as;
+	cme->cme_vaddr = vaddr;
+	cme->cme_slot = slot;
+	cme->cme_lastuse = timer_ticks();
+	as->as_rss++;
+	spinlock_release(&coremap_lock);
+}
+
+/*
+ * Note a fault on resident page PADDR. A clean page stays read-only
+ * until it is written; then its swap copy is no longer any use.
+ */
+void
+page_use(paddr_t paddr, int faulttype, bool *writeable)
+{
+	struct coremap_entry *cme = coremap_entry(paddr);
+	unsigned slot = 0;
+	bool dirtied = false;
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(cme->cme_pageable);
+	cme->cme_ref = 1;
+	cme->cme_lastuse = timer_ticks();
+	if (cme->cme_clean) {
+		if (faulttype == VM_FAULT_READ) {
+			*writeable = false;
+		}
+		else {
+			cme->cme_clean = 0;
+			slot = cme->cme_slot;
+			dirtied = true;
+		}
+	}
+	spinlock_release(&coremap_lock);
+
+	if (dirtied) {
+		swap_free(slot);
+	}
+}
+
+/*
+ * Read page VADDR of AS, whose entry is *PE, back in from swap.
+ */
+int
+page_swapin(struct addrspace *as, vaddr_t vaddr, pte_t *pe)
+{
+	paddr_t paddr;
+	unsigned slot;
+	int result;
+
+	KASSERT(*pe & PTE_SWAPPED);
+	paddr = getuserpages(1);
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	slot = PTE_SLOT(*pe);
+	result = swap_read(slot, paddr);
+	if (result) {
+		free_ppages(paddr);
+		return result;
+	}
+	*pe = paddr | PTE_VALID;
+	page_setowner(paddr, as, vaddr, true, slot);
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	vmstats_inc(VMSTAT_SWAP_FILE_READ);
+	vm_pagein(true);
+	return 0;
+}
+
+/*
+ * Throw away a pageable page, wherever it is, and clear its entry.
+ */
+void
+page_discard(pte_t *pe)
+{
+	if (*pe & PTE_SWAPPED) {
+		swap_free(PTE_SLOT(*pe));
+	}
+	else if (*pe & PTE_VALID) {
+		KASSERT((*pe & PTE_READONLY) == 0);
+		free_ppages(*pe & PTE_FRAME);
+	}
+	*pe = 0;
+}
+
+/*
+ * Copy the page whose entry is *FROM, in memory or not, into a new
+ * frame for page VADDR of AS, for fork.
+ */
+int
+page_copy(const pte_t *from, struct addrspace *as, vaddr_t vaddr,
+	  pte_t *ret)
+{
+	paddr_t paddr;
+	int result;
+
+	paddr = getuserpages(1);
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	/* (making room may have paged *FROM out) */
+	if (*from & PTE_SWAPPED) {
+		result = swap_read(PTE_SLOT(*from), paddr);
+		if (result) {
+			free_ppages(paddr);
+			return result;
+		}
+	}
+	else {
+		memmove((void *)PADDR_TO_KVADDR(paddr),
+			(const void *)PADDR_TO_KVADDR(*from & PTE_FRAME),
+			PAGE_SIZE);
+	}
+	page_setowner(paddr, as, vaddr, false, 0);
+	*ret = paddr | PTE_VALID;
+	return 0;
+}
+
+/*
+ * Run the clock and page out up to SWAP_BATCH pages. Returns the
+ * number of frames freed; 0 means there's nothing that can go.
+ */
+static
+unsigned
+page_evict(void)
+{
+	paddr_t victims[SWAP_BATCH], dirty[SWAP_BATCH];
+	unsigned slots[SWAP_BATCH];
+	struct shootbatch sb;
+	struct coremap_entry *cme;
+	struct addrspace *as;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	pte_t *pe;
+	unsigned i, n, ndirty, pass, scanned, slot, now;
+	bool clean, full = false;
+	int result;
+
+	KASSERT(lock_do_i_hold(mm_lock));
+
+	now = timer_ticks();
+	n = ndirty = 0;
+	shoot_init(&sb);
+	for (pass = 0; pass < 2 && n == 0 && !full; pass++) {
+		for (scanned = 0; n < SWAP_BATCH && scanned < coremap_npages;
+		     scanned++) {
+			spinlock_acquire(&coremap_lock);
+			i = coremap_hand;
+			coremap_hand = (coremap_hand + 1) % coremap_npages;
+			cme = &coremap[i];
+			if (!cme->cme_pageable) {
+				spinlock_release(&coremap_lock);
+				continue;
+			}
+			as = cme->cme_as;
+			vaddr = cme->cme_vaddr;
+			if (cme->cme_ref) {
+				cme->cme_ref = 0;
+				cme->cme_lastuse = now;
+				spinlock_release(&coremap_lock);
+				/* so we see the next use */
+				shoot_page(&sb, as, vaddr);
+				continue;
+			}
+			if (pass == 0 && !as->as_suspended &&
+			    now - cme->cme_lastuse <= as_wstau(as, now)) {
+				/* in its working set */
+				spinlock_release(&coremap_lock);
+				continue;
+			}
+			clean = cme->cme_clean;
+			slot = cme->cme_slot;
+			spinlock_release(&coremap_lock);
+
+			paddr = coremap_base + i * PAGE_SIZE;
+			if (!clean) {
+				if (swap_alloc(&slot)) {
+					full = true;
+					break;
+				}
+				dirty[ndirty] = paddr;
+				slots[ndirty] = slot;
+				ndirty++;
+			}
+
+			/* The slot now belongs to the page entry. */
+			spinlock_acquire(&coremap_lock);
+			cme->cme_pageable = 0;
+			cme->cme_clean = 0;
+			as->as_rss--;
+			spinlock_release(&coremap_lock);
+
+			pe = page_entry(as, vaddr);
+			KASSERT((*pe & PTE_FRAME) == paddr &&
+				(*pe & PTE_VALID));
+			*pe = PTE_MKSWAP(slot);
+			shoot_page(&sb, as, vaddr);
+			victims[n++] = paddr;
+		}
+	}
+
+	/* Nobody may use the victims once they're written. */
+	shoot_flush(&sb);
+
+	if (pass == 2 && n > 0) {
+		/* Everything's in some working set. */
+		vm_thrash_until = now + VM_THRASH_TICKS;
+		vm_evict_forced += n;
+	}
+	else {
+		vm_evict_ws += n;
+	}
+
+	if (ndirty > 0) {
+		result = swap_write(dirty, slots, ndirty);
+		if (result) {
+			panic("swap: write failed: %s\n", strerror(result));
+		}
+		for (i=0; i<ndirty; i++) {
+			vmstats_inc(VMSTAT_SWAP_FILE_WRITE);
+		}
+	}
+	for (i=0; i<n; i++) {
+		free_ppages(victims[i]);
+	}
+	return n;
+}
+
+/*
+ * Allocate frames for user memory, paging something out if memory is
+ * short. A few pages are left free for the kernel, which can't page
+ * anything out to get memory, unless there's nothing else left. Takes
+ * mm_lock if the caller doesn't hold it.
+ */
+paddr_t
+getuserpages(unsigned long npages)
+{
+	paddr_t paddr;
+	bool held;
+
+	held = lock_do_i_hold(mm_lock);
+	if (!held) {
+		lock_acquire(mm_lock);
+	}
+	while (1) {
+		if (coremap_avail() >= npages + SWAP_KRESERVE) {
+			paddr = getppages(npages);
+			if (paddr != 0) {
+				break;
+			}
+		}
+		if (page_evict() == 0) {
+			paddr = getppages(npages);
+			break;
+		}
+	}
+	if (!held) {
+		lock_release(mm_lock);
+	}
+	return paddr;
+}
+
+/*
+ * The address space for load control to suspend: of those with pages
+ * in memory, the one whose process has the lowest priority, and of
+ * those the youngest, which has done the least work. NULL if there's
+ * only one, since suspending it would gain nothing.
+ */
+static
+struct addrspace *
+as_loadvictim(void)
+{
+	struct addrspace *as, *victim = NULL;
+	unsigned count = 0;
+
+	spinlock_acquire(&as_all_lock);
+	for (as = as_all; as != NULL; as = as->as_next) {
+		if (as->as_rss == 0) {
+			continue;
+		}
+		count++;
+		if (victim == NULL || as->as_pri < victim->as_pri ||
+		    (as->as_pri == victim->as_pri &&
+		     as->as_seq > victim->as_seq)) {
+			victim = as;
+		}
+	}
+	spinlock_release(&as_all_lock);
+	return count > 1 ? victim : NULL;
+}
+
+/*
+ * Load control, on each fault on pageable memory. While memory is
+ * overcommitted, the victim process is put to sleep for a while each
+ * time it faults. Its pages then fall out of its working set and go
+ * first, and the others get to run in the memory it had.
+ */
+void
+vm_loadcontrol(struct addrspace *as)
+{
+	KASSERT(lock_do_i_hold(mm_lock));
+
+	as->as_pri = curthread->t_basepri;
+	if ((int)(vm_thrash_until - timer_ticks()) <= 0) {
+		return;
+	}
+	if (as_loadvictim() != as) {
+		return;
+	}
+	as->as_suspended = true;
+	vm_suspends++;
+	cv_timedwait(vm_loadcv, mm_lock, VM_SUSPEND_TICKS);
+	as->as_suspended = false;
+}
+
+/*
+ * Memory has been freed; let suspended processes try again. Caller
+ * holds mm_lock.
+ */
+void
+vm_loadwakeup(void)
+{
+	cv_broadcast(vm_loadcv, mm_lock);
+}
+
+void
+paging_printstats(void)
+{
+	kprintf("VM: pages out: %u outside working sets, %u inside; "
+		"%u load control suspensions\n",
+		vm_evict_ws, vm_evict_forced, vm_suspends);
+}
+
+#endif /* OPT_A3 */
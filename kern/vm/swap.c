@@ -0,0 +1,145 @@
+/*
+ * Swap space. See swap.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <bitmap.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <vm.h>
+#include <swap.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/* Longest run of slots written with one uio. */
+#define SWAP_MAXRUN	16
+
+static struct vnode *swap_vnode;	/* NULL if no swap */
+static struct bitmap *swap_map;		/* slots in use */
+static unsigned swap_nslots;
+static unsigned swap_nused;
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+
+void
+swap_bootstrap(void)
+{
+	char path[sizeof(SWAP_DEVICE)];
+	struct stat st;
+	int result;
+
+	/* vfs_open destroys the path */
+	strcpy(path, SWAP_DEVICE);
+	result = vfs_open(path, O_RDWR, 0, &swap_vnode);
+	if (result) {
+		kprintf("swap: no %s (%s); not swapping\n", SWAP_DEVICE,
+			strerror(result));
+		swap_vnode = NULL;
+		return;
+	}
+	result = VOP_STAT(swap_vnode, &st);
+	if (result) {
+		panic("swap: stat %s: %s\n", SWAP_DEVICE, strerror(result));
+	}
+	swap_nslots = st.st_size / PAGE_SIZE;
+	swap_map = bitmap_create(swap_nslots);
+	if (swap_map == NULL) {
+		panic("swap: out of memory\n");
+	}
+	kprintf("swap: %u pages on %s\n", swap_nslots, SWAP_DEVICE);
+}
+
+int
+swap_alloc(unsigned *slot)
+{
+	int result;
+
+	if (swap_vnode == NULL) {
+		return ENOSPC;
+	}
+	spinlock_acquire(&swap_lock);
+	result = bitmap_alloc(swap_map, slot);
+	if (!result) {
+		swap_nused++;
+	}
+	spinlock_release(&swap_lock);
+	return result;
+}
+
+void
+swap_free(unsigned slot)
+{
+	KASSERT(slot < swap_nslots);
+	spinlock_acquire(&swap_lock);
+	KASSERT(bitmap_isset(swap_map, slot));
+	bitmap_unmark(swap_map, slot);
+	swap_nused--;
+	spinlock_release(&swap_lock);
+}
+
+unsigned
+swap_nfree(void)
+{
+	return swap_nslots - swap_nused;
+}
+
+int
+swap_read(unsigned slot, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(slot < swap_nslots);
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  (off_t)slot * PAGE_SIZE, UIO_READ);
+	result = VOP_READ(swap_vnode, &ku);
+	if (result) {
+		return result;
+	}
+	return ku.uio_resid == 0 ? 0 : EIO;
+}
+
+int
+swap_write(const paddr_t *paddrs, const unsigned *slots, unsigned n)
+{
+	struct iovec iov[SWAP_MAXRUN];
+	struct uio ku;
+	unsigned i, run;
+	int result;
+
+	for (i=0; i<n; i += run) {
+		KASSERT(slots[i] < swap_nslots);
+		for (run = 0; run < SWAP_MAXRUN && i + run < n; run++) {
+			if (slots[i + run] != slots[i] + run) {
+				break;
+			}
+			iov[run].iov_kbase =
+				(void *)PADDR_TO_KVADDR(paddrs[i + run]);
+			iov[run].iov_len = PAGE_SIZE;
+		}
+		ku.uio_iov = iov;
+		ku.uio_iovcnt = run;
+		ku.uio_offset = (off_t)slots[i] * PAGE_SIZE;
+		ku.uio_resid = run * PAGE_SIZE;
+		ku.uio_segflg = UIO_SYSSPACE;
+		ku.uio_rw = UIO_WRITE;
+		ku.uio_space = NULL;
+		result = VOP_WRITE(swap_vnode, &ku);
+		if (result) {
+			return result;
+		}
+		if (ku.uio_resid != 0) {
+			return EIO;
+		}
+	}
+	return 0;
+}
+
+#endif /* OPT_A3 */
@@ -0,0 +1,360 @@
+/*
+ * Demand loading and shared text. See vmprivate.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vm.h>
+#include <uw-vmstats.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+/*
+ * Demand loading. Each region of a program remembers which part of
+ * the executable it was defined from, and a page is read in (or
+ * zeroed) by vm_fault the first time it is touched. The loader holds
+ * a reference to the vnode for as long as that may happen. A page has
+ * been loaded exactly when its page table entry (or, for text, its
+ * entry in ts_pages) is nonzero.
+ *
+ * Text. A read-only region of an executable has a textseg, which holds
+ * a frame for each page once it's been read in. Address spaces map
+ * those frames with PTE_READONLY entries, which aren't theirs to free.
+ *
+ * Once loaded, a textseg is offered to every other address space
+ * running that executable, keyed by (vnode, vbase, npages), so a page
+ * one process has faulted in is there for all of them. An entry is
+ * freed, frames and all, when the last address space using it goes
+ * away, so text is only shared among processes that are running at
+ * the same time. (Rewriting an executable while it runs will not be
+ * noticed, as with ETXTBSY on other systems.)
+ *
+ * text_lock protects textsegs, and each textseg's ts_pages and
+ * ts_refcount.
+ */
+static struct textseg *textsegs;
+static struct lock *text_lock;
+
+void
+text_bootstrap(void)
+{
+	text_lock = lock_create("text");
+	if (text_lock == NULL) {
+		panic("vm_bootstrap: out of memory\n");
+	}
+}
+
+struct segload *
+segload_create(void)
+{
+	struct segload *sl;
+
+	sl = kmalloc(sizeof(*sl));
+	if (sl == NULL) {
+		return NULL;
+	}
+	sl->sl_vnode = NULL;
+	sl->sl_offset = 0;
+	sl->sl_vaddr = 0;
+	sl->sl_filesz = 0;
+	return sl;
+}
+
+void
+segload_destroy(struct segload *sl)
+{
+	if (sl->sl_vnode != NULL) {
+		VOP_DECREF(sl->sl_vnode);
+	}
+	kfree(sl);
+}
+
+/*
+ * Copy of a private loader, for fork: the child still has to load
+ * whatever the parent hasn't.
+ */
+struct segload *
+segload_copy(struct segload *old)
+{
+	struct segload *sl;
+
+	sl = segload_create();
+	if (sl == NULL) {
+		return NULL;
+	}
+	if (old->sl_vnode != NULL) {
+		VOP_INCREF(old->sl_vnode);
+	}
+	sl->sl_vnode = old->sl_vnode;
+	sl->sl_offset = old->sl_offset;
+	sl->sl_vaddr = old->sl_vaddr;
+	sl->sl_filesz = old->sl_filesz;
+	return sl;
+}
+
+/*
+ * Fill in the page at VADDR (physical page PADDR) of a region: the
+ * part of it that lies in the file-backed part of the segment is read
+ * from the executable, and everything else is zeroed.
+ */
+int
+segload_page(struct segload *sl, vaddr_t vaddr, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *kva;
+	vaddr_t start, end;
+	int result;
+
+	kva = (char *)PADDR_TO_KVADDR(paddr);
+	start = vaddr;
+	end = vaddr + PAGE_SIZE;
+	if (start < sl->sl_vaddr) {
+		start = sl->sl_vaddr;
+	}
+	if (end > sl->sl_vaddr + sl->sl_filesz) {
+		end = sl->sl_vaddr + sl->sl_filesz;
+	}
+
+	if (sl->sl_vnode == NULL || start >= end) {
+		bzero(kva, PAGE_SIZE);
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+		vm_pagein(false);
+		return 0;
+	}
+
+	bzero(kva, start - vaddr);
+	bzero(kva + (end - vaddr), vaddr + PAGE_SIZE - end);
+	uio_kinit(&iov, &ku, kva + (start - vaddr), end - start,
+		  sl->sl_offset + (start - sl->sl_vaddr), UIO_READ);
+	result = VOP_READ(sl->sl_vnode, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		kprintf("vm: short read on executable - file truncated?\n");
+		return ENOEXEC;
+	}
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	vmstats_inc(VMSTAT_ELF_FILE_READ);
+	vm_pagein(true);
+	return 0;
+}
+
+/*
+ * Whether page VADDR of a segment is all zeros to begin with.
+ */
+bool
+segload_zeroonly(struct segload *sl, vaddr_t vaddr)
+{
+	return sl->sl_vnode == NULL ||
+		vaddr + PAGE_SIZE <= sl->sl_vaddr ||
+		vaddr >= sl->sl_vaddr + sl->sl_filesz;
+}
+
+/*
+ * Text operations.
+ */
+struct textseg *
+text_create(vaddr_t vbase, size_t npages)
+{
+	struct textseg *ts;
+
+	ts = kmalloc(sizeof(*ts));
+	if (ts == NULL) {
+		return NULL;
+	}
+	ts->ts_pages = kmalloc(npages * sizeof(paddr_t));
+	if (ts->ts_pages == NULL) {
+		kfree(ts);
+		return NULL;
+	}
+	bzero(ts->ts_pages, npages * sizeof(paddr_t));
+	ts->ts_vbase = vbase;
+	ts->ts_npages = npages;
+	ts->ts_load.sl_vnode = NULL;
+	ts->ts_load.sl_offset = 0;
+	ts->ts_load.sl_vaddr = 0;
+	ts->ts_load.sl_filesz = 0;
+	ts->ts_listed = false;
+	ts->ts_refcount = 1;
+	ts->ts_next = NULL;
+	return ts;
+}
+
+/*
+ * The listed text for this region of V, if any. Caller holds
+ * text_lock.
+ */
+static
+struct textseg *
+text_find(struct vnode *v, vaddr_t vbase, size_t npages)
+{
+	struct textseg *ts;
+
+	KASSERT(lock_do_i_hold(text_lock));
+	for (ts = textsegs; ts != NULL; ts = ts->ts_next) {
+		if (ts->ts_load.sl_vnode == v && ts->ts_vbase == vbase &&
+		    ts->ts_npages == npages) {
+			return ts;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * If the region is already in use, use it rather than loading our
+ * own copy.
+ */
+void
+text_attach(struct vnode *v, vaddr_t vbase, size_t npages,
+	    struct textseg **text)
+{
+	struct textseg *ts;
+
+	KASSERT(*text == NULL);
+	lock_acquire(text_lock);
+	ts = text_find(v, vbase, npages);
+	if (ts != NULL) {
+		ts->ts_refcount++;
+		*text = ts;
+	}
+	lock_release(text_lock);
+}
+
+/*
+ * Offer a newly set up region to later loaders of the same file. If
+ * someone else got there first it just stays private.
+ */
+void
+text_publish(struct textseg *ts)
+{
+	struct vnode *v = ts->ts_load.sl_vnode;
+
+	lock_acquire(text_lock);
+	if (ts->ts_listed || v == NULL ||
+	    text_find(v, ts->ts_vbase, ts->ts_npages) != NULL) {
+		lock_release(text_lock);
+		return;
+	}
+	ts->ts_listed = true;
+	ts->ts_next = textsegs;
+	textsegs = ts;
+	lock_release(text_lock);
+}
+
+void
+text_ref(struct textseg *ts)
+{
+	lock_acquire(text_lock);
+	KASSERT(ts->ts_refcount > 0);
+	ts->ts_refcount++;
+	lock_release(text_lock);
+}
+
+void
+text_release(struct textseg *ts)
+{
+	struct textseg **tsp;
+	unsigned i;
+
+	lock_acquire(text_lock);
+	KASSERT(ts->ts_refcount > 0);
+	ts->ts_refcount--;
+	if (ts->ts_refcount > 0) {
+		lock_release(text_lock);
+		return;
+	}
+	if (ts->ts_listed) {
+		for (tsp = &textsegs; *tsp != ts; tsp = &(*tsp)->ts_next) {
+			KASSERT(*tsp != NULL);
+		}
+		*tsp = ts->ts_next;
+	}
+	lock_release(text_lock);
+
+	for (i=0; i<ts->ts_npages; i++) {
+		if (ts->ts_pages[i] != 0) {
+			free_ppages(ts->ts_pages[i]);
+		}
+	}
+	if (ts->ts_load.sl_vnode != NULL) {
+		VOP_DECREF(ts->ts_load.sl_vnode);
+	}
+	kfree(ts->ts_pages);
+	kfree(ts);
+}
+
+/*
+ * Find or read in text page VADDR. The file is read without text_lock
+ * held, since the file system may be copying to a user buffer of ours
+ * and take a fault on this very text; if two processes load the same
+ * page at once, the loser's copy is thrown away.
+ */
+int
+text_page(struct textseg *ts, vaddr_t vaddr, paddr_t *ret)
+{
+	unsigned index;
+	paddr_t paddr;
+	int result;
+
+	index = (vaddr - ts->ts_vbase) / PAGE_SIZE;
+	KASSERT(index < ts->ts_npages);
+
+	lock_acquire(text_lock);
+	paddr = ts->ts_pages[index];
+	lock_release(text_lock);
+	if (paddr != 0) {
+		*ret = paddr;
+		return 0;
+	}
+
+	paddr = getuserpages(1);
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	result = segload_page(&ts->ts_load, vaddr, paddr);
+	if (result) {
+		free_ppages(paddr);
+		return result;
+	}
+	lock_acquire(text_lock);
+	if (ts->ts_pages[index] == 0) {
+		ts->ts_pages[index] = paddr;
+		paddr = 0;
+	}
+	*ret = ts->ts_pages[index];
+	lock_release(text_lock);
+	if (paddr != 0) {
+		free_ppages(paddr);
+	}
+	return 0;
+}
+
+/*
+ * Pages of text that are in memory. (Read without text_lock; it's
+ * only for reports.)
+ */
+unsigned
+text_count(struct textseg *ts)
+{
+	unsigned i, count = 0;
+
+	if (ts == NULL) {
+		return 0;
+	}
+	for (i=0; i<ts->ts_npages; i++) {
+		if (ts->ts_pages[i] != 0) {
+			count++;
+		}
+	}
+	return count;
+}
+
+#endif /* OPT_A3 */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The VM system: bootstrap, fault handling and reports. See vm.h and
+ * vmprivate.h.
+ *
+ * The pieces:
+ *    coremap.c       - physical pages, and a pool of zeroed ones
+ *    paging.c        - page-out (WSClock) and load control
+ *    addrspace.c     - address spaces, page tables and faults on them
+ *    text.c          - demand loading and shared text
+ *    mmap.c          - mappings of files and anonymous memory
+ *    pagetable.c     - two-level page tables
+ *    swap.c          - swap space
+ *    arch/mips/vm/tlb.c - the TLB, the software TLB, and shootdowns
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <clock.h>
+#include <timer.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <swap.h>
+#include <uw-vmstats.h>
+#include <vmprivate.h>
+#include "opt-A3.h"
+
+#if OPT_A3
+
+struct lock *mm_lock;
+
+void
+vm_bootstrap(void)
+{
+	mm_lock = lock_create("mmap");
+	if (mm_lock == NULL) {
+		panic("vm_bootstrap: out of memory\n");
+	}
+	text_bootstrap();
+	paging_bootstrap();
+	vmstats_init();
+	coremap_bootstrap();
+	swap_bootstrap();
+}
+
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	struct addrspace *as;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+		/*
+		 * Could be the first write to a page mapped read-only
+		 * to zero_page, or to a shared mapped page.
+		 */
+		break;
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (swtlb_refill(faulttype, faultaddress)) {
+		return 0;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = curproc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+
+	return as_fault(as, faulttype, faultaddress);
+}
+
+/*
+ * Resident set and working set size, in pages, and fault rate of each
+ * address space. Text isn't paged out, so it counts in both.
+ */
+void
+vm_printstats(void)
+{
+	struct addrspace *as;
+	unsigned now, fixed;
+
+	now = timer_ticks();
+	paging_printstats();
+	tlb_printstats();
+	kprintf("VM: %5s %-15s %6s %6s %8s %8s\n",
+		"as", "name", "rss", "ws", "faults", "faults/s");
+
+	spinlock_acquire(&as_all_lock);
+	for (as = as_all; as != NULL; as = as->as_next) {
+		fixed = text_count(as->as_text1) + text_count(as->as_text2);
+		kprintf("VM: %5u %-15s %6u %6u %8u %8u%s\n", as->as_seq,
+			as->as_name, fixed + as->as_rss,
+			fixed + as_wscount(as, now),
+			as->as_faults, as_faultrate(as, now),
+			as->as_suspended ? " (suspended)" : "");
+	}
+	spinlock_release(&as_all_lock);
+}
+
+#endif /* OPT_A3 */
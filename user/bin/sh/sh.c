@@ -354,11 +354,15 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	/*
+	 * vfork: the child only execs, so there's no point copying
+	 * our address space for it.
+	 */
+	pid = vfork();
 	switch (pid) {
 		case -1:
 			/* error */
-			warn("fork");
+			warn("vfork");
 			return _MKWAIT_EXIT(255);
 		case 0:
 			/* child */
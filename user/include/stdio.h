@@ -41,6 +41,90 @@
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/*
+ * Streams.
+ *
+ * A stream buffers reads or writes on a file descriptor so that
+ * programs doing character-at-a-time I/O don't pay a system call per
+ * character. stdout is line-buffered: it is flushed at each newline,
+ * before reading from stdin, before fork(), and at exit(). stderr is
+ * unbuffered. stdin is also unbuffered by default, because the console
+ * driver doesn't do line editing or echo and programs like the shell
+ * need to see each character as it is typed. Streams from fopen are
+ * fully buffered.
+ *
+ * The fields are private to libc.
+ */
+typedef struct __stream {
+	int _fd;			/* file descriptor */
+	unsigned _flags;		/* __S* flags below */
+	char *_buf;			/* buffer, or NULL if not yet set up */
+	size_t _bufsize;		/* size of _buf */
+	size_t _pos;			/* next byte to read or write */
+	size_t _len;			/* bytes of _buf valid (when reading) */
+	char _onebuf;			/* buffer for unbuffered reads */
+	struct __stream *_next;		/* list of all streams */
+} FILE;
+
+#define __SRD	0x0001		/* open for reading */
+#define __SWR	0x0002		/* open for writing */
+#define __SLBF	0x0004		/* line-buffered */
+#define __SNBF	0x0008		/* unbuffered */
+#define __SREADING 0x0010	/* buffer holds read-ahead */
+#define __SWRITING 0x0020	/* buffer holds unwritten data */
+#define __SEOF	0x0040		/* hit end of file */
+#define __SERR	0x0080		/* I/O error */
+#define __SMBF	0x0100		/* _buf is from malloc */
+
+extern FILE __stdin, __stdout, __stderr;
+#define stdin (&__stdin)
+#define stdout (&__stdout)
+#define stderr (&__stderr)
+
+/* Buffering modes for setvbuf, and the default buffer size. */
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+#define BUFSIZ 1024
+
+/* Opening, closing, and buffer control */
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *f);
+int fflush(FILE *f);		/* NULL means all streams */
+int setvbuf(FILE *f, char *buf, int mode, size_t size);
+void setbuf(FILE *f, char *buf);
+
+/* Stream I/O */
+int fgetc(FILE *f);
+int getc(FILE *f);
+char *fgets(char *buf, int len, FILE *f);
+size_t fread(void *buf, size_t size, size_t count, FILE *f);
+int fputc(int ch, FILE *f);
+int putc(int ch, FILE *f);
+int fputs(const char *str, FILE *f);
+size_t fwrite(const void *buf, size_t size, size_t count, FILE *f);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
+
+/* Stream state */
+int feof(FILE *f);
+int ferror(FILE *f);
+void clearerr(FILE *f);
+int fileno(FILE *f);
+
+/*
+ * Stream internals (for libc internal use only)
+ *    __stdio_write - write LEN bytes from DATA into the stream.
+ *                    Returns 0, or EOF on error.
+ *    __stdio_fill  - refill the read buffer. Returns 0, or EOF at end
+ *                    of file or on error.
+ *    __stdio_streams - list of all open streams, linked by _next.
+ */
+int __stdio_write(FILE *f, const char *data, size_t len);
+int __stdio_fill(FILE *f);
+extern FILE *__stdio_streams;
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -63,7 +147,7 @@ int puts(const char *);
 /* Nonstandard C, hence the __. */
 int __puts(const char *);
 
-/* Writes one character. Returns it. */
+/* Writes one character to stdout. Returns it, or EOF on error. */
 int putchar(int);
 
 /* Reads one character (0-255) or returns EOF on error. */
@@ -0,0 +1,16 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+/*
+ * Memory mapping. Get the PROT_* and MAP_* constants from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/mman.h>
+
+#define MAP_ANONYMOUS	MAP_ANON
+#define MAP_FAILED	((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+
+#endif /* _SYS_MMAN_H_ */
@@ -0,0 +1,13 @@
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+/*
+ * Get struct rusage and the RUSAGE_* constants from the kernel.
+ */
+#include <sys/types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+
+int getrusage(int who, struct rusage *usage);
+
+#endif /* _SYS_RESOURCE_H_ */
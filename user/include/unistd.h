@@ -38,6 +38,7 @@
  * about the kern/ headers.
  */
 #include <kern/fcntl.h>
+#include <kern/iovec.h>
 #include <kern/ioctl.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
@@ -151,9 +152,22 @@ int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+int preadv(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+int pwritev(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+/* Restrict the calling process to the cpus set in CPUMASK (bit N = cpu N). */
+int setaffinity(unsigned int cpumask);
+/*
+ * Like fork, but the child runs in the parent's memory until it calls
+ * execv or _exit (which is all it may do), and the parent waits.
+ */
+pid_t vfork(void);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
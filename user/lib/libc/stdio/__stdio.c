@@ -0,0 +1,169 @@
+/*
+ * Stream buffering internals: the standard streams, and the routines
+ * that move data between a stream's buffer and its file descriptor.
+ * See <stdio.h>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+static char stdoutbuf[BUFSIZ];
+
+FILE __stderr = {
+	STDERR_FILENO, __SWR|__SNBF, NULL, 0, 0, 0, 0, NULL
+};
+FILE __stdout = {
+	STDOUT_FILENO, __SWR|__SLBF, stdoutbuf, BUFSIZ, 0, 0, 0, &__stderr
+};
+FILE __stdin = {
+	STDIN_FILENO, __SRD|__SNBF, NULL, 0, 0, 0, 0, &__stdout
+};
+
+FILE *__stdio_streams = &__stdin;
+
+/*
+ * Make sure the stream has a buffer. Unbuffered streams use the
+ * one-byte buffer inside the FILE for reading; if we can't get memory
+ * for a real buffer, fall back to that.
+ */
+static
+void
+getbuf(FILE *f)
+{
+	if (f->_buf != NULL) {
+		return;
+	}
+	if ((f->_flags & __SNBF) == 0) {
+		if (f->_bufsize == 0) {
+			f->_bufsize = BUFSIZ;
+		}
+		f->_buf = malloc(f->_bufsize);
+		if (f->_buf != NULL) {
+			f->_flags |= __SMBF;
+			return;
+		}
+		f->_flags &= ~__SLBF;
+		f->_flags |= __SNBF;
+	}
+	f->_buf = &f->_onebuf;
+	f->_bufsize = 1;
+}
+
+/*
+ * Write all of DATA straight to the file.
+ */
+static
+int
+writeall(FILE *f, const char *data, size_t len)
+{
+	int r;
+
+	while (len > 0) {
+		r = write(f->_fd, data, len);
+		if (r <= 0) {
+			f->_flags |= __SERR;
+			return EOF;
+		}
+		data += r;
+		len -= r;
+	}
+	return 0;
+}
+
+int
+__stdio_write(FILE *f, const char *data, size_t len)
+{
+	size_t i, n;
+	int newline = 0;
+
+	if ((f->_flags & __SWR) == 0) {
+		f->_flags |= __SERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if (f->_flags & __SREADING) {
+		/* drop the read-ahead */
+		fflush(f);
+	}
+
+	getbuf(f);
+	if (f->_flags & __SNBF) {
+		return writeall(f, data, len);
+	}
+
+	if (f->_flags & __SLBF) {
+		for (i=0; i<len; i++) {
+			if (data[i] == '\n') {
+				newline = 1;
+				break;
+			}
+		}
+	}
+
+	/* Big writes into an empty buffer needn't be copied. */
+	if (f->_pos == 0 && len >= f->_bufsize) {
+		return writeall(f, data, len);
+	}
+
+	while (len > 0) {
+		n = f->_bufsize - f->_pos;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(f->_buf + f->_pos, data, n);
+		f->_pos += n;
+		/* again each time round, since fflush clears it */
+		f->_flags |= __SWRITING;
+		data += n;
+		len -= n;
+		if (f->_pos == f->_bufsize && fflush(f)) {
+			return EOF;
+		}
+	}
+
+	if (newline) {
+		return fflush(f);
+	}
+	return 0;
+}
+
+int
+__stdio_fill(FILE *f)
+{
+	int r;
+
+	if ((f->_flags & __SRD) == 0) {
+		f->_flags |= __SERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if ((f->_flags & __SWRITING) && fflush(f)) {
+		return EOF;
+	}
+
+	/*
+	 * We may be about to wait for input, so make sure whatever
+	 * prompt has been printed is actually visible.
+	 */
+	if ((__stdout._flags & (__SLBF|__SWRITING)) == (__SLBF|__SWRITING)) {
+		fflush(stdout);
+	}
+
+	getbuf(f);
+	r = read(f->_fd, f->_buf, f->_bufsize);
+	if (r < 0) {
+		f->_flags |= __SERR;
+		return EOF;
+	}
+	if (r == 0) {
+		f->_flags |= __SEOF;
+		return EOF;
+	}
+	f->_pos = 0;
+	f->_len = r;
+	f->_flags |= __SREADING;
+	return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+/*
+ * C standard I/O functions - stream state.
+ */
+
+int
+feof(FILE *f)
+{
+	return (f->_flags & __SEOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+	return (f->_flags & __SERR) != 0;
+}
+
+void
+clearerr(FILE *f)
+{
+	f->_flags &= ~(__SEOF | __SERR);
+}
+
+int
+fileno(FILE *f)
+{
+	return f->_fd;
+}
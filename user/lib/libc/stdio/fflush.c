@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * C standard I/O function - flush a stream, or all streams if F is
+ * NULL.
+ *
+ * For a stream being written, this writes out the buffer. For a stream
+ * being read, it throws away the read-ahead and seeks the file back to
+ * where the program thinks it is, so the file descriptor can be used
+ * directly afterwards. (That fails harmlessly on the console.)
+ */
+
+int
+fflush(FILE *f)
+{
+	size_t done;
+	int r, ret, olderrno;
+
+	if (f == NULL) {
+		ret = 0;
+		for (f = __stdio_streams; f != NULL; f = f->_next) {
+			if (fflush(f)) {
+				ret = EOF;
+			}
+		}
+		return ret;
+	}
+
+	if (f->_flags & __SWRITING) {
+		done = 0;
+		while (done < f->_pos) {
+			r = write(f->_fd, f->_buf + done, f->_pos - done);
+			if (r <= 0) {
+				f->_flags |= __SERR;
+				return EOF;
+			}
+			done += r;
+		}
+		f->_pos = 0;
+		f->_flags &= ~__SWRITING;
+	}
+	else if (f->_flags & __SREADING) {
+		if (f->_pos < f->_len) {
+			olderrno = errno;
+			lseek(f->_fd, -(off_t)(f->_len - f->_pos), SEEK_CUR);
+			errno = olderrno;
+		}
+		f->_pos = f->_len = 0;
+		f->_flags &= ~__SREADING;
+	}
+	return 0;
+}
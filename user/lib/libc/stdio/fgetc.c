@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * C standard I/O functions - read characters from a stream.
+ */
+
+int
+fgetc(FILE *f)
+{
+	if ((f->_flags & __SREADING) == 0 || f->_pos >= f->_len) {
+		if (__stdio_fill(f)) {
+			return EOF;
+		}
+	}
+
+	/* Cast through unsigned char so EOF is distinct; see getchar. */
+	return (int)(unsigned char)f->_buf[f->_pos++];
+}
+
+int
+getc(FILE *f)
+{
+	return fgetc(f);
+}
+
+char *
+fgets(char *buf, int len, FILE *f)
+{
+	int i, ch;
+
+	for (i=0; i<len-1; i++) {
+		ch = fgetc(f);
+		if (ch == EOF) {
+			break;
+		}
+		buf[i] = ch;
+		if (ch == '\n') {
+			i++;
+			break;
+		}
+	}
+	if (i == 0 && len > 1) {
+		return NULL;
+	}
+	buf[i] = 0;
+	return buf;
+}
+
+size_t
+fread(void *buf, size_t size, size_t count, FILE *f)
+{
+	char *p = buf;
+	size_t want, n;
+
+	want = size * count;
+	while (want > 0) {
+		if ((f->_flags & __SREADING) == 0 || f->_pos >= f->_len) {
+			if (__stdio_fill(f)) {
+				break;
+			}
+		}
+		n = f->_len - f->_pos;
+		if (n > want) {
+			n = want;
+		}
+		memcpy(p, f->_buf + f->_pos, n);
+		f->_pos += n;
+		p += n;
+		want -= n;
+	}
+	return size == 0 ? 0 : (p - (char *)buf) / size;
+}
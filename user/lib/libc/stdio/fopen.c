@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * C standard I/O functions - open and close streams.
+ */
+
+/*
+ * Parse an fopen mode string into stream flags and open(2) flags.
+ * The "b" modifier is accepted and ignored.
+ */
+static
+int
+parsemode(const char *mode, unsigned *flags, int *oflags)
+{
+	switch (mode[0]) {
+	    case 'r':
+		*flags = __SRD;
+		*oflags = O_RDONLY;
+		break;
+	    case 'w':
+		*flags = __SWR;
+		*oflags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	    case 'a':
+		*flags = __SWR;
+		*oflags = O_WRONLY | O_CREAT | O_APPEND;
+		break;
+	    default:
+		errno = EINVAL;
+		return -1;
+	}
+	for (mode++; *mode; mode++) {
+		if (*mode == '+') {
+			*flags = __SRD | __SWR;
+			*oflags = (*oflags & ~O_ACCMODE) | O_RDWR;
+		}
+		else if (*mode != 'b') {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+FILE *
+fdopen(int fd, const char *mode)
+{
+	FILE *f;
+	unsigned flags;
+	int oflags;
+
+	if (parsemode(mode, &flags, &oflags)) {
+		return NULL;
+	}
+
+	f = malloc(sizeof(FILE));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->_fd = fd;
+	f->_flags = flags;
+	f->_buf = NULL;
+	f->_bufsize = 0;
+	f->_pos = 0;
+	f->_len = 0;
+	f->_onebuf = 0;
+
+	f->_next = __stdio_streams;
+	__stdio_streams = f;
+	return f;
+}
+
+FILE *
+fopen(const char *path, const char *mode)
+{
+	FILE *f;
+	unsigned flags;
+	int oflags, fd;
+
+	if (parsemode(mode, &flags, &oflags)) {
+		return NULL;
+	}
+	fd = open(path, oflags, 0664);
+	if (fd < 0) {
+		return NULL;
+	}
+	f = fdopen(fd, mode);
+	if (f == NULL) {
+		close(fd);
+	}
+	return f;
+}
+
+int
+fclose(FILE *f)
+{
+	FILE **fp;
+	int ret;
+
+	ret = fflush(f);
+	if (close(f->_fd)) {
+		ret = EOF;
+	}
+	if (f->_flags & __SMBF) {
+		free(f->_buf);
+	}
+
+	if (f == stdin || f == stdout || f == stderr) {
+		/* not ours to free; just leave it unusable */
+		f->_flags = 0;
+		f->_buf = NULL;
+		f->_pos = f->_len = 0;
+		return ret;
+	}
+
+	for (fp = &__stdio_streams; *fp != NULL; fp = &(*fp)->_next) {
+		if (*fp == f) {
+			*fp = f->_next;
+			break;
+		}
+	}
+	free(f);
+	return ret;
+}
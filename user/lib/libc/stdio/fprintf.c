@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+/*
+ * fprintf - C standard I/O function.
+ */
+
+/*
+ * Function passed to __vprintf to do the actual output.
+ */
+static
+void
+__fprintf_send(void *mydata, const char *data, size_t len)
+{
+	__stdio_write(mydata, data, len);
+}
+
+int
+fprintf(FILE *f, const char *fmt, ...)
+{
+	int chars;
+	va_list ap;
+	va_start(ap, fmt);
+	chars = vfprintf(f, fmt, ap);
+	va_end(ap);
+	return chars;
+}
+
+/* vfprintf: call __vprintf to do the work, then check for errors. */
+int
+vfprintf(FILE *f, const char *fmt, va_list ap)
+{
+	int chars, olderr;
+
+	olderr = f->_flags & __SERR;
+	chars = __vprintf(__fprintf_send, f, fmt, ap);
+	if (!olderr && (f->_flags & __SERR)) {
+		return -1;
+	}
+	return chars;
+}
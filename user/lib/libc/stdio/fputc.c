@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * C standard I/O functions - write characters to a stream.
+ */
+
+int
+fputc(int ch, FILE *f)
+{
+	char c = ch;
+
+	if (__stdio_write(f, &c, 1)) {
+		return EOF;
+	}
+	return (int)(unsigned char)c;
+}
+
+int
+putc(int ch, FILE *f)
+{
+	return fputc(ch, f);
+}
+
+int
+fputs(const char *str, FILE *f)
+{
+	if (__stdio_write(f, str, strlen(str))) {
+		return EOF;
+	}
+	return 0;
+}
+
+size_t
+fwrite(const void *buf, size_t size, size_t count, FILE *f)
+{
+	if (__stdio_write(f, buf, size * count)) {
+		return 0;
+	}
+	return count;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/*
+ * C standard I/O functions - choose how a stream is buffered.
+ *
+ * If BUF is NULL for a buffered mode, a buffer of SIZE bytes (or
+ * BUFSIZ if SIZE is 0) is allocated on first use.
+ */
+
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (fflush(f)) {
+		return -1;
+	}
+	if (f->_flags & __SMBF) {
+		free(f->_buf);
+	}
+	f->_flags &= ~(__SLBF | __SNBF | __SMBF);
+	f->_buf = NULL;
+	f->_bufsize = 0;
+
+	switch (mode) {
+	    case _IONBF:
+		f->_flags |= __SNBF;
+		return 0;
+	    case _IOLBF:
+		f->_flags |= __SLBF;
+		break;
+	}
+	if (buf != NULL && size > 0) {
+		f->_buf = buf;
+	}
+	f->_bufsize = size;
+	return 0;
+}
+
+void
+setbuf(FILE *f, char *buf)
+{
+	setvbuf(f, buf, buf != NULL ? _IOFBF : _IONBF, BUFSIZ);
+}
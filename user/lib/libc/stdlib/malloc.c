@@ -30,10 +30,11 @@
 /*
  * User-level malloc and free implementation.
  *
- * This is a basic first-fit allocator. It's intended to be simple and
- * easy to follow. It performs abysmally if the heap becomes larger than
- * physical memory. To get (much) better out-of-core performance, port
- * the kernel's malloc. :-)
+ * This is a segregated-fit allocator: free blocks are kept on lists by
+ * size class, so neither malloc nor free has to look at the rest of
+ * the heap. Blocks still carry boundary tags (offsets to both
+ * neighbours) so that free can coalesce in constant time. See
+ * design/usermalloc.txt.
  */
 
 #include <stdlib.h>
@@ -119,6 +120,8 @@ struct mheader {
  * 
  * M_MKFIELD:		prepare a value for mh_next/prevblock.
  * 			(value should include the header size)
+ *
+ * M_FREE:		return the free-list links of a free block
  */
 
 #define M_NEXTOFF(mh)	((size_t)(((size_t)((mh)->mh_nextblock))<<MBLOCKSHIFT))
@@ -133,12 +136,45 @@ struct mheader {
 
 #define M_MKFIELD(off)	((off)>>MBLOCKSHIFT)
 
+#define M_FREE(mh)	((struct mfree *)M_DATA(mh))
+
+/*
+ * Free-list links. These live in the data area of a free block, which
+ * is always at least MBLOCKSIZE bytes, room for exactly two pointers.
+ */
+struct mfree {
+	struct mheader *mf_next;
+	struct mheader *mf_prev;
+};
+
+/*
+ * Size classes ("bins").
+ *
+ * The first NSMALL bins hold free blocks of exactly one size each:
+ * bin i holds blocks with (i+1)*MBLOCKSIZE bytes of data. Above that,
+ * each bin holds a power-of-two range of sizes, and malloc takes the
+ * best fit within the bin. A bitmap records which bins are nonempty
+ * so that finding the next bin up with something in it is quick.
+ *
+ * MGROW is the least we ask sbrk for at a time; the rest of the chunk
+ * goes on the free lists.
+ */
+#define NSMALL		64
+#define MLARGESHIFT	(MBLOCKSHIFT + 6)	/* log2(NSMALL*MBLOCKSIZE) */
+#define NBINS		(NSMALL + sizeof(size_t)*8 - MLARGESHIFT)
+#define MAPBITS		32
+#define MGROW		4096
+
 ////////////////////////////////////////////////////////////
 
 /*
- * Static variables - the bottom and top addresses of the heap.
+ * Static variables - the bottom and top addresses of the heap, the
+ * highest block in the heap, and the free lists.
  */
 static uintptr_t __heapbase, __heaptop;
+static struct mheader *__heaplast;
+static struct mheader *__malloc_bins[NBINS];
+static uint32_t __malloc_binmap[(NBINS + MAPBITS - 1) / MAPBITS];
 
 /*
  * Setup function.
@@ -161,6 +197,12 @@ __malloc_init(void)
 	if (1<<MBLOCKSHIFT != MBLOCKSIZE) {
 		errx(1, "malloc: Internal error - MBLOCKSHIFT wrong");
 	}
+	if (sizeof(struct mfree) > MBLOCKSIZE) {
+		errx(1, "malloc: Internal error - free links too big");
+	}
+	if (NSMALL * MBLOCKSIZE != 1 << MLARGESHIFT) {
+		errx(1, "malloc: Internal error - MLARGESHIFT wrong");
+	}
 
 	/* init should only be called once. */
 	if (__heapbase!=0 || __heaptop!=0) {
@@ -204,10 +246,142 @@ __malloc_init(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Free list handling.
+ */
+
+/*
+ * Return the bin for a block with SIZE bytes of data.
+ */
+static
+unsigned
+__malloc_bin(size_t size)
+{
+	unsigned bin;
+
+	if (size <= NSMALL * MBLOCKSIZE) {
+		return (size >> MBLOCKSHIFT) - 1;
+	}
+	bin = NSMALL;
+	for (size >>= MLARGESHIFT; size > 1; size >>= 1) {
+		bin++;
+	}
+	return bin;
+}
+
+/*
+ * Put a free block on the list for its size.
+ */
+static
+void
+__malloc_link(struct mheader *mh)
+{
+	unsigned bin = __malloc_bin(M_SIZE(mh));
+	struct mheader *head = __malloc_bins[bin];
+
+	M_FREE(mh)->mf_next = head;
+	M_FREE(mh)->mf_prev = NULL;
+	if (head != NULL) {
+		M_FREE(head)->mf_prev = mh;
+	}
+	__malloc_bins[bin] = mh;
+	__malloc_binmap[bin / MAPBITS] |= (uint32_t)1 << (bin % MAPBITS);
+}
+
+/*
+ * Take a free block off its list.
+ */
+static
+void
+__malloc_unlink(struct mheader *mh)
+{
+	unsigned bin = __malloc_bin(M_SIZE(mh));
+	struct mheader *next = M_FREE(mh)->mf_next;
+	struct mheader *prev = M_FREE(mh)->mf_prev;
+
+	if (prev != NULL) {
+		M_FREE(prev)->mf_next = next;
+	}
+	else {
+		if (__malloc_bins[bin] != mh) {
+			errx(1, "malloc: Heap corrupt; free block %p"
+			     " not on its list", M_DATA(mh));
+		}
+		__malloc_bins[bin] = next;
+		if (next == NULL) {
+			__malloc_binmap[bin / MAPBITS] &=
+				~((uint32_t)1 << (bin % MAPBITS));
+		}
+	}
+	if (next != NULL) {
+		M_FREE(next)->mf_prev = prev;
+	}
+}
+
+/*
+ * Find and unlink a free block with at least SIZE bytes of data, or
+ * return NULL if there isn't one.
+ */
+static
+struct mheader *
+__malloc_find(size_t size)
+{
+	struct mheader *mh, *best;
+	unsigned bin, word;
+	uint32_t bits;
+
+	bin = __malloc_bin(size);
+
+	/*
+	 * Small bins hold one size, so anything in ours fits. A large
+	 * bin holds a range; take the closest fit from it, if any.
+	 */
+	best = NULL;
+	for (mh = __malloc_bins[bin]; mh != NULL; mh = M_FREE(mh)->mf_next) {
+		if (M_SIZE(mh) >= size &&
+		    (best == NULL || M_SIZE(mh) < M_SIZE(best))) {
+			best = mh;
+			if (bin < NSMALL || M_SIZE(mh) == size) {
+				break;
+			}
+		}
+	}
+
+	/* Otherwise anything in a higher bin is big enough. */
+	if (best == NULL) {
+		bin++;
+		word = bin / MAPBITS;
+		bits = bin % MAPBITS == 0 ? 0xffffffff :
+			~(((uint32_t)1 << (bin % MAPBITS)) - 1);
+		for (; word < sizeof(__malloc_binmap)/sizeof(uint32_t);
+		     word++) {
+			bits &= __malloc_binmap[word];
+			if (bits != 0) {
+				bin = word * MAPBITS;
+				while ((bits & 1) == 0) {
+					bits >>= 1;
+					bin++;
+				}
+				best = __malloc_bins[bin];
+				break;
+			}
+			bits = 0xffffffff;
+		}
+	}
+
+	if (best != NULL) {
+		__malloc_unlink(best);
+	}
+	return best;
+}
+
+////////////////////////////////////////////////////////////
+
 #ifdef MALLOCDEBUG
 
 /*
- * Debugging print function to iterate and dump the entire heap.
+ * Debugging print function to iterate and dump the entire heap, and
+ * check it against the free lists.
  */
 static
 void
@@ -216,10 +390,14 @@ __malloc_dump(void)
 	struct mheader *mh;
 	uintptr_t i;
 	size_t rightprevblock;
+	unsigned bin, nfree, nlisted;
+	int lastfree;
 
 	warnx("heap: ************************************************");
 
 	rightprevblock = 0;
+	nfree = 0;
+	lastfree = 0;
 	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
 		mh = (struct mheader *) i;
 		if (!M_OK(mh)) {
@@ -237,6 +415,20 @@ __malloc_dump(void)
 		}
 		rightprevblock = mh->mh_nextblock;
 
+		if (!mh->mh_inuse) {
+			if (lastfree) {
+				errx(1, "malloc: Heap corrupt; free block"
+				     " at 0x%lx not coalesced",
+				     (unsigned long) i);
+			}
+			nfree++;
+		}
+		lastfree = !mh->mh_inuse;
+		if (i + M_NEXTOFF(mh) == __heaptop && mh != __heaplast) {
+			errx(1, "malloc: Heap corrupt; last block is 0x%lx,"
+			     " not %p", (unsigned long) i, __heaplast);
+		}
+
 		warnx("heap: 0x%lx 0x%-6lx (next: 0x%lx) %s",
 		      (unsigned long) i + MBLOCKSIZE,
 		      (unsigned long) M_SIZE(mh),
@@ -247,6 +439,35 @@ __malloc_dump(void)
 		errx(1, "malloc: Heap corrupt; ran off end");
 	}
 
+	nlisted = 0;
+	for (bin=0; bin<NBINS; bin++) {
+		if ((__malloc_bins[bin] != NULL) !=
+		    ((__malloc_binmap[bin / MAPBITS] >> (bin % MAPBITS)) & 1)) {
+			errx(1, "malloc: bin %u disagrees with bin map", bin);
+		}
+		for (mh = __malloc_bins[bin]; mh != NULL;
+		     mh = M_FREE(mh)->mf_next) {
+			if ((uintptr_t)mh < __heapbase ||
+			    (uintptr_t)mh >= __heaptop || !M_OK(mh)) {
+				errx(1, "malloc: Heap corrupt; bad block %p"
+				     " on free list %u", mh, bin);
+			}
+			if (mh->mh_inuse) {
+				errx(1, "malloc: Heap corrupt; block %p"
+				     " on free list %u is in use", mh, bin);
+			}
+			if (__malloc_bin(M_SIZE(mh)) != bin) {
+				errx(1, "malloc: Heap corrupt; block %p"
+				     " on wrong free list %u", mh, bin);
+			}
+			nlisted++;
+		}
+	}
+	if (nlisted != nfree) {
+		errx(1, "malloc: Heap corrupt; %u free blocks but %u listed",
+		     nfree, nlisted);
+	}
+
 	warnx("heap: ************************************************");
 }
 
@@ -279,10 +500,58 @@ __malloc_sbrk(size_t size)
 	return x;
 }
 
+/*
+ * Grow the heap so there's a free block of at least SIZE bytes at the
+ * top, and return it (not on any free list). If the highest block is
+ * already free it is extended; otherwise a new block is made. We grow
+ * by at least MGROW at a time to save on sbrk calls.
+ */
+static
+struct mheader *
+__malloc_grow(size_t size)
+{
+	struct mheader *mh, *last = __heaplast;
+	size_t need, grow;
+
+	if (last != NULL && !last->mh_inuse) {
+		need = size - M_SIZE(last);
+	}
+	else {
+		need = size + MBLOCKSIZE;
+	}
+	grow = need < MGROW ? MGROW : need;
+
+	mh = __malloc_sbrk(grow);
+	if (mh == NULL && grow > need) {
+		/* maybe there's room for what we actually need */
+		grow = need;
+		mh = __malloc_sbrk(grow);
+	}
+	if (mh == NULL) {
+		return NULL;
+	}
+
+	if (last != NULL && !last->mh_inuse) {
+		__malloc_unlink(last);
+		last->mh_nextblock = M_MKFIELD(M_NEXTOFF(last) + grow);
+		return last;
+	}
+
+	mh->mh_prevblock = last == NULL ? 0 : last->mh_nextblock;
+	mh->mh_magic1 = MMAGIC;
+	mh->mh_magic2 = MMAGIC;
+	mh->mh_pad = 0;
+	mh->mh_inuse = 0;
+	mh->mh_nextblock = M_MKFIELD(grow);
+	__heaplast = mh;
+	return mh;
+}
+
 /*
  * Make a new (free) block from the block passed in, leaving size
- * bytes for data in the current block. size must be a multiple of
- * MBLOCKSIZE.
+ * bytes for data in the current block, and put it on the free list.
+ * size must be a multiple of MBLOCKSIZE. The block after mh must not
+ * be free, so the new block needn't be merged with it.
  *
  * Only split if the excess space is at least twice the blocksize -
  * one blocksize to hold a header and one for data.
@@ -324,6 +593,11 @@ __malloc_split(struct mheader *mh, size_t size)
 	if (mhnext != (struct mheader *) __heaptop) {
 		mhnext->mh_prevblock = mhnew->mh_nextblock;
 	}
+	else {
+		__heaplast = mhnew;
+	}
+
+	__malloc_link(mhnew);
 }
 
 /*
@@ -333,8 +607,6 @@ void *
 malloc(size_t size)
 {
 	struct mheader *mh;
-	uintptr_t i;
-	size_t rightprevblock;
 
 	if (__heapbase==0) {
 		__malloc_init();
@@ -351,74 +623,39 @@ malloc(size_t size)
 	__malloc_dump();
 #endif
 
-	/* Round size up to an integral number of blocks. */
-	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
-
 	/*
-	 * First-fit search algorithm for available blocks.
-	 * Check to make sure the next/previous sizes all agree.
+	 * Round size up to an integral number of blocks, and to at
+	 * least one block so there's room for the free-list links
+	 * once it's freed. Watch out for wraparound.
 	 */
-	rightprevblock = 0;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
-		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
-			     "(should be %lu)",
-			     (unsigned long) i, 
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
-		}
-		rightprevblock = mh->mh_nextblock;
-
-		/* Can't allocate a block that's in use. */
-		if (mh->mh_inuse) {
-			continue;
-		}
+	if (size > (size_t)-1 - 2*MBLOCKSIZE - MGROW) {
+		return NULL;
+	}
+	if (size == 0) {
+		size = MBLOCKSIZE;
+	}
+	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
 
-		/* Can't allocate a block that isn't big enough. */
-		if (M_SIZE(mh) < size) {
-			continue;
+	mh = __malloc_find(size);
+	if (mh == NULL) {
+		/* Didn't find anything. Expand the heap. */
+		mh = __malloc_grow(size);
+		if (mh == NULL) {
+			return NULL;
 		}
-
-		/* Try splitting block. */
-		__malloc_split(mh, size);
-
-		/*
-		 * Now, allocate.
-		 */
-		mh->mh_inuse = 1;
-
-#ifdef MALLOCDEBUG
-		warnx("malloc: allocating at %p", M_DATA(mh));
-		__malloc_dump();
-#endif
-		return M_DATA(mh);
 	}
-	if (i!=__heaptop) {
-		errx(1, "malloc: Heap corrupt; ran off end");
+	if (!M_OK(mh) || mh->mh_inuse) {
+		errx(1, "malloc: Heap corrupt; bad free block at %p",
+		     M_DATA(mh));
 	}
 
+	/* Try splitting block. */
+	__malloc_split(mh, size);
+
 	/*
-	 * Didn't find anything. Expand the heap.
+	 * Now, allocate.
 	 */
-
-	mh = __malloc_sbrk(size + MBLOCKSIZE);
-	if (mh == NULL) {
-		return NULL;
-	}
-
-	mh->mh_prevblock = rightprevblock;
-	mh->mh_magic1 = MMAGIC;
-	mh->mh_magic2 = MMAGIC;
-	mh->mh_pad = 0;
 	mh->mh_inuse = 1;
-	mh->mh_nextblock = M_MKFIELD(size + MBLOCKSIZE);
 
 #ifdef MALLOCDEBUG
 	warnx("malloc: allocating at %p", M_DATA(mh));
@@ -429,6 +666,7 @@ malloc(size_t size)
 
 ////////////////////////////////////////////////////////////
 
+#ifdef MALLOCDEBUG
 /*
  * Clear a range of memory with 0xdeadbeef.
  * ptr must be suitably aligned.
@@ -443,13 +681,15 @@ __malloc_deadbeef(void *ptr, size_t size)
 		x[i] = 0xdeadbeef;
 	}
 }
+#endif
 
 /*
- * Attempt to merge two adjacent blocks (mh below mhnext).
+ * Merge two adjacent free blocks (mh below mhnext). Neither may be on
+ * a free list.
  */
 static
 void
-__malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
+__malloc_merge(struct mheader *mh, struct mheader *mhnext)
 {
 	struct mheader *mhnextnext;
 
@@ -457,10 +697,6 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 		errx(1, "free: Heap corrupt (%p and %p inconsistent)",
 		     mh, mhnext);
 	}
-	if (mh->mh_inuse || mhnext->mh_inuse) {
-		/* can't merge */
-		return;
-	}
 
 	mhnextnext = M_NEXT(mhnext);
 
@@ -470,9 +706,14 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 	if (mhnextnext != (struct mheader *)__heaptop) {
 		mhnextnext->mh_prevblock = mh->mh_nextblock;
 	}
+	else {
+		__heaplast = mh;
+	}
 
+#ifdef MALLOCDEBUG
 	/* Deadbeef out the memory used by the now-obsolete header */
 	__malloc_deadbeef(mhnext, sizeof(struct mheader));
+#endif
 }
 
 /*
@@ -517,21 +758,33 @@ free(void *x)
 	/* mark it free */
 	mh->mh_inuse = 0;
 
+#ifdef MALLOCDEBUG
 	/* wipe it */
 	__malloc_deadbeef(M_DATA(mh), M_SIZE(mh));
+#endif
 
 	/* Try merging with the block above (but not if we're at the top) */
 	mhnext = M_NEXT(mh);
-	if (mhnext != (struct mheader *)__heaptop) {
-		__malloc_trymerge(mh, mhnext);
+	if (mhnext != (struct mheader *)__heaptop && !mhnext->mh_inuse) {
+		__malloc_unlink(mhnext);
+		__malloc_merge(mh, mhnext);
 	}
 
 	/* Try merging with the block below (but not if we're at the bottom) */
 	if (mh != (struct mheader *)__heapbase) {
 		mhprev = M_PREV(mh);
-		__malloc_trymerge(mhprev, mh);
+		if (!M_OK(mhprev)) {
+			errx(1, "free: Heap corrupt (bad header below %p)", x);
+		}
+		if (!mhprev->mh_inuse) {
+			__malloc_unlink(mhprev);
+			__malloc_merge(mhprev, mh);
+			mh = mhprev;
+		}
 	}
 
+	__malloc_link(mh);
+
 #ifdef MALLOCDEBUG
 	warnx("free: freed %p", x);
 	__malloc_dump();
@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <string.h>
 
 /*
@@ -37,10 +38,38 @@ void *
 memset(void *ptr, int ch, size_t len)
 {
 	char *p = ptr;
-	size_t i;
-	
-	for (i=0; i<len; i++) {
-		p[i] = ch;
+	unsigned long *lp, w;
+
+	/*
+	 * Like bzero: bytes until aligned, then words (CH in every
+	 * byte), four to a loop iteration, then the leftover bytes.
+	 */
+	if (len >= 2 * sizeof(long)) {
+		while ((uintptr_t)p % sizeof(long) != 0) {
+			*p++ = ch;
+			len--;
+		}
+
+		w = ((unsigned long)-1 / 0xff) * (unsigned char)ch;
+		lp = (unsigned long *)p;
+		while (len >= 4 * sizeof(long)) {
+			lp[0] = w;
+			lp[1] = w;
+			lp[2] = w;
+			lp[3] = w;
+			lp += 4;
+			len -= 4 * sizeof(long);
+		}
+		while (len >= sizeof(long)) {
+			*lp++ = w;
+			len -= sizeof(long);
+		}
+		p = (char *)lp;
+	}
+
+	while (len > 0) {
+		*p++ = ch;
+		len--;
 	}
 
 	return ptr;
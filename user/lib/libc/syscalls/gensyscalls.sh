@@ -16,6 +16,8 @@ awk '
     # And, do not read lines that do not match the approximate right pattern.
     look && /^#define SYS_/ && NF==3 {
 	sub("^SYS_", "", $2);
+	# fork is wrapped in libc (unix/fork.c) so it can flush stdio.
+	if ($2 == "fork") $2 = "__fork";
 	# print the name of the call and the number.
 	print $2, $3;
     }
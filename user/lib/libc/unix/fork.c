@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * fork is wrapped so that output buffered by stdio before the fork is
+ * written once, by the parent, rather than once by each process. The
+ * system call stub is generated under the name __fork.
+ *
+ * vfork is not wrapped; a vfork child shares our memory, and with it
+ * the stdio buffers, until it execs or exits.
+ */
+
+pid_t __fork(void);
+
+pid_t
+fork(void)
+{
+	fflush(NULL);
+	return __fork();
+}
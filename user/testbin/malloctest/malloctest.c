@@ -623,6 +623,99 @@ test7(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Test 8
+ *
+ * Allocator throughput. Does the same random mix of mallocs and
+ * frees with a small and then a large number of blocks live at once,
+ * and reports operations per second for each. With a first-fit
+ * allocator the second is much slower, because every malloc walks
+ * every live block; with size-class free lists the two should be
+ * about the same.
+ */
+
+#define BENCH_OPS	200000
+#define BENCH_MAXLIVE	1024
+
+static
+unsigned long
+nowms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	secs = __time(NULL, &nsecs);
+	return secs*1000 + nsecs/1000000;
+}
+
+static
+int
+bench(int nlive)
+{
+	static const int sizes[8] = { 13, 17, 24, 69, 100, 176, 433, 871 };
+	static void *ptrs[BENCH_MAXLIVE];
+	unsigned long start, ms;
+	int i, n;
+
+	srandom(0);
+	for (i=0; i<nlive; i++) {
+		ptrs[i] = malloc(sizes[random()%8]);
+		if (ptrs[i] == NULL) {
+			printf("malloc failed filling the heap\n");
+			return -1;
+		}
+		*(int *)ptrs[i] = i;
+	}
+
+	start = nowms();
+	for (i=0; i<BENCH_OPS; i++) {
+		n = random()%nlive;
+		if (ptrs[n] == NULL) {
+			ptrs[n] = malloc(sizes[random()%8]);
+			if (ptrs[n] == NULL) {
+				printf("malloc failed\n");
+				return -1;
+			}
+			*(int *)ptrs[n] = n;
+		}
+		else {
+			if (*(int *)ptrs[n] != n) {
+				printf("block %d corrupt\n", n);
+				return -1;
+			}
+			free(ptrs[n]);
+			ptrs[n] = NULL;
+		}
+	}
+	ms = nowms() - start;
+
+	for (i=0; i<nlive; i++) {
+		free(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("  %4d live blocks: %d ops in %lu ms (%lu ops/sec)\n",
+	       nlive, BENCH_OPS, ms, BENCH_OPS * 1000UL / ms);
+	return 0;
+}
+
+static
+void
+test8(void)
+{
+	printf("Beginning malloc test 8\n");
+	if (bench(64) || bench(BENCH_MAXLIVE)) {
+		printf("FAILED malloc test 8\n");
+		return;
+	}
+	printf("Passed malloc test 8\n");
+}
+
+////////////////////////////////////////////////////////////
+
 static struct {
 	int num;
 	const char *desc;
@@ -635,6 +728,7 @@ static struct {
 	{ 5, "Stress test", test5 },
 	{ 6, "Randomized stress test", test6 },
 	{ 7, "Stress test with particular seed", test7 },
+	{ 8, "Throughput benchmark", test8 },
 	{ -1, NULL, NULL }
 };
 
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * strtest: check and time the libc memory and string routines.
+ *
+ * The versions in common/libc and user/lib/libc are compiled right
+ * into this program under other names, so the same tests can be run
+ * on the host (built with hostcompat, as host-strtest) as well as on
+ * OS/161. Each is checked against a simple byte-at-a-time version for
+ * every combination of source and destination alignment and a range
+ * of lengths, including that nothing outside the buffer is touched,
+ * and then both versions are timed on aligned and misaligned data.
+ *
+ * Usage: strtest [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#ifdef HOST
+#include "hostcompat.h"
+#endif
+
+/*
+ * The routines under test.
+ */
+void *t_memcpy(void *dst, const void *src, size_t len);
+void *t_memmove(void *dst, const void *src, size_t len);
+void *t_memset(void *ptr, int ch, size_t len);
+void t_bzero(void *vblock, size_t len);
+size_t t_strlen(const char *str);
+char *t_strchr(const char *s, int ch_arg);
+int t_strcmp(const char *a, const char *b);
+
+#define memcpy t_memcpy
+#define memmove t_memmove
+#define memset t_memset
+#define bzero t_bzero
+#define strlen t_strlen
+#define strchr t_strchr
+#define strcmp t_strcmp
+#include "../../../common/libc/string/memcpy.c"
+#include "../../../common/libc/string/memmove.c"
+#include "../../../common/libc/string/bzero.c"
+#include "../../../common/libc/string/strlen.c"
+#undef ONES
+#undef HIGHS
+#undef HASZERO
+#include "../../../common/libc/string/strchr.c"
+#undef ONES
+#undef HIGHS
+#undef HASZERO
+#include "../../../common/libc/string/strcmp.c"
+#include "../../lib/libc/string/memset.c"
+#undef memcpy
+#undef memmove
+#undef memset
+#undef bzero
+#undef strlen
+#undef strchr
+#undef strcmp
+
+/*
+ * Byte-at-a-time reference versions. The volatiles keep the compiler
+ * from turning them into word copies (or calls to the host's memcpy)
+ * behind our backs, which would make the timings meaningless.
+ */
+static
+void
+ref_memmove(volatile char *d, const volatile char *s, size_t len)
+{
+	size_t i;
+
+	if ((uintptr_t)d < (uintptr_t)s) {
+		for (i=0; i<len; i++) {
+			d[i] = s[i];
+		}
+	}
+	else {
+		for (i=len; i>0; i--) {
+			d[i-1] = s[i-1];
+		}
+	}
+}
+
+static
+void
+ref_memset(volatile char *p, int ch, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = ch;
+	}
+}
+
+static
+size_t
+ref_strlen(const volatile char *s)
+{
+	size_t i;
+
+	for (i=0; s[i] != 0; i++) {
+		/* nothing */
+	}
+	return i;
+}
+
+static
+const char *
+ref_strchr(const char *s, char ch)
+{
+	for (; *s != ch; s++) {
+		if (*s == 0) {
+			return NULL;
+		}
+	}
+	return s;
+}
+
+static
+int
+ref_strcmp(const char *a, const char *b)
+{
+	size_t i;
+
+	for (i=0; a[i] != 0 && a[i] == b[i]; i++) {
+		/* nothing */
+	}
+	if ((unsigned char)a[i] > (unsigned char)b[i]) {
+		return 1;
+	}
+	return a[i] == b[i] ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////////
+// correctness
+
+#define ALIGNS	(2 * sizeof(long))	/* offsets tried */
+#define MAXLEN	300			/* lengths tried: 0..MAXLEN-1 */
+#define BUFLEN	(ALIGNS + MAXLEN + 2 * ALIGNS)
+
+static long abuf[BUFLEN / sizeof(long) + 1];
+static long bbuf[BUFLEN / sizeof(long) + 1];
+static char expect[BUFLEN];
+static unsigned errors;
+
+static
+void
+fill(char *buf, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		/* no zeros, and some bytes with the high bit set */
+		buf[i] = 1 + (i * 7 + seed) % 251;
+	}
+}
+
+static
+void
+check(const char *what, const char *got, size_t off, size_t len)
+{
+	if (memcmp(got, expect, BUFLEN) != 0) {
+		if (errors++ < 10) {
+			printf("%s: wrong result at offset %lu length %lu\n",
+			       what, (unsigned long)off, (unsigned long)len);
+		}
+	}
+}
+
+static
+void
+test_mem(void)
+{
+	char *a = (char *)abuf, *b = (char *)bbuf;
+	size_t da, sa, len;
+
+	for (da=0; da<ALIGNS; da++) {
+		for (len=0; len<MAXLEN; len++) {
+			fill(a, BUFLEN, 3);
+			memcpy(expect, a, BUFLEN);
+			ref_memset(expect + da, 0, len);
+			t_bzero(a + da, len);
+			check("bzero", a, da, len);
+
+			fill(a, BUFLEN, 5);
+			memcpy(expect, a, BUFLEN);
+			ref_memset(expect + da, 0xa5, len);
+			t_memset(a + da, 0xa5, len);
+			check("memset", a, da, len);
+
+			for (sa=0; sa<ALIGNS; sa++) {
+				fill(a, BUFLEN, 7);
+				fill(b, BUFLEN, 11);
+				memcpy(expect, a, BUFLEN);
+				ref_memmove(expect + da, b + sa, len);
+				t_memcpy(a + da, b + sa, len);
+				check("memcpy", a, da, len);
+
+				/* overlapping, both directions */
+				fill(a, BUFLEN, 13);
+				memcpy(expect, a, BUFLEN);
+				ref_memmove(expect + da, expect + sa + ALIGNS,
+					    len);
+				t_memmove(a + da, a + sa + ALIGNS, len);
+				check("memmove down", a, da, len);
+
+				fill(a, BUFLEN, 17);
+				memcpy(expect, a, BUFLEN);
+				ref_memmove(expect + sa + ALIGNS, expect + da,
+					    len);
+				t_memmove(a + sa + ALIGNS, a + da, len);
+				check("memmove up", a, da, len);
+			}
+		}
+	}
+}
+
+static
+void
+test_str(void)
+{
+	char *a = (char *)abuf, *b = (char *)bbuf;
+	size_t sa, sb, len, pos;
+	const char *r1, *r2;
+	int c1, c2;
+
+	for (sa=0; sa<ALIGNS; sa++) {
+		for (len=0; len<MAXLEN; len++) {
+			fill(a, BUFLEN, 19);
+			a[sa + len] = 0;
+
+			if (t_strlen(a + sa) != ref_strlen(a + sa)) {
+				errors++;
+				printf("strlen: wrong at offset %lu length %lu\n",
+				       (unsigned long)sa, (unsigned long)len);
+			}
+
+			for (pos=0; pos<=len; pos += 1 + len / 8) {
+				r1 = t_strchr(a + sa, a[sa + pos]);
+				r2 = ref_strchr(a + sa, a[sa + pos]);
+				if (r1 != r2) {
+					errors++;
+					printf("strchr: wrong at offset %lu "
+					       "length %lu\n", (unsigned long)sa,
+					       (unsigned long)len);
+				}
+			}
+			if (t_strchr(a + sa, 0x80) != ref_strchr(a + sa, 0x80) ||
+			    t_strchr(a + sa, 0) != a + sa + len) {
+				errors++;
+				printf("strchr: wrong at offset %lu length %lu\n",
+				       (unsigned long)sa, (unsigned long)len);
+			}
+
+			for (sb=0; sb<ALIGNS; sb += 3) {
+				/* equal, then differing at each position */
+				memcpy(b + sb, a + sa, len + 1);
+				for (pos=0; pos<=len; pos += 1 + len / 8) {
+					c1 = t_strcmp(a + sa, b + sb);
+					c2 = ref_strcmp(a + sa, b + sb);
+					if (c1 != c2) {
+						errors++;
+						printf("strcmp: wrong at offsets "
+						       "%lu/%lu length %lu\n",
+						       (unsigned long)sa,
+						       (unsigned long)sb,
+						       (unsigned long)len);
+					}
+					b[sb + pos] ^= 0x81;
+					c1 = t_strcmp(a + sa, b + sb);
+					c2 = ref_strcmp(a + sa, b + sb);
+					b[sb + pos] ^= 0x81;
+					if (c1 != c2) {
+						errors++;
+						printf("strcmp: wrong at offsets "
+						       "%lu/%lu length %lu "
+						       "position %lu\n",
+						       (unsigned long)sa,
+						       (unsigned long)sb,
+						       (unsigned long)len,
+						       (unsigned long)pos);
+					}
+				}
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// speed
+
+#define BIGLEN	8192
+
+static long bigsrc[BIGLEN / sizeof(long) + 1];
+static long bigdst[BIGLEN / sizeof(long) + 1];
+
+static
+unsigned long
+msecs(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000UL + nsecs / 1000000;
+}
+
+static
+void
+report(const char *what, unsigned long ms_ref, unsigned long ms_new,
+       unsigned long bytes)
+{
+	if (ms_ref == 0) {
+		ms_ref = 1;
+	}
+	if (ms_new == 0) {
+		ms_new = 1;
+	}
+	printf("%-22s bytes: %6lu KB/s, words: %6lu KB/s\n", what,
+	       bytes / 1024 * 1000 / ms_ref, bytes / 1024 * 1000 / ms_new);
+}
+
+static
+void
+bench(unsigned iters)
+{
+	char *s = (char *)bigsrc, *d = (char *)bigdst;
+	unsigned long t0, t1, t2, total;
+	unsigned i;
+	size_t n;
+
+	total = (unsigned long)iters * (BIGLEN - 8);
+	fill(s, BIGLEN, 23);
+	s[BIGLEN - 1] = 0;
+
+	t0 = msecs();
+	for (i=0; i<iters; i++) {
+		ref_memmove(d, s, BIGLEN - 8);
+	}
+	t1 = msecs();
+	for (i=0; i<iters; i++) {
+		t_memcpy(d, s, BIGLEN - 8);
+	}
+	t2 = msecs();
+	report("memcpy, aligned", t1 - t0, t2 - t1, total);
+
+	t0 = msecs();
+	for (i=0; i<iters; i++) {
+		ref_memmove(d + 3, s + 3, BIGLEN - 8);
+	}
+	t1 = msecs();
+	for (i=0; i<iters; i++) {
+		t_memcpy(d + 3, s + 3, BIGLEN - 8);
+	}
+	t2 = msecs();
+	report("memcpy, both offset 3", t1 - t0, t2 - t1, total);
+
+	t0 = msecs();
+	for (i=0; i<iters; i++) {
+		ref_memmove(d + 3, d, BIGLEN - 8);
+	}
+	t1 = msecs();
+	for (i=0; i<iters; i++) {
+		t_memmove(d + 3, d, BIGLEN - 8);
+	}
+	t2 = msecs();
+	report("memmove up, unaligned", t1 - t0, t2 - t1, total);
+
+	t0 = msecs();
+	for (i=0; i<iters; i++) {
+		ref_memset(d, 0, BIGLEN - 8);
+	}
+	t1 = msecs();
+	for (i=0; i<iters; i++) {
+		t_bzero(d, BIGLEN - 8);
+	}
+	t2 = msecs();
+	report("bzero", t1 - t0, t2 - t1, total);
+
+	n = 0;
+	t0 = msecs();
+	for (i=0; i<iters; i++) {
+		n += ref_strlen(s + (i & 7));
+	}
+	t1 = msecs();
+	for (i=0; i<iters; i++) {
+		n -= t_strlen(s + (i & 7));
+	}
+	t2 = msecs();
+	report("strlen", t1 - t0, t2 - t1, total);
+	if (n != 0) {
+		errors++;
+		printf("strlen: results differ\n");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned iters = 2000;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	if (argc > 1) {
+		iters = atoi(argv[1]);
+	}
+
+	test_mem();
+	test_str();
+	if (errors > 0) {
+		errx(1, "%u errors", errors);
+	}
+	printf("strtest: all results correct\n");
+
+	bench(iters);
+	if (errors > 0) {
+		errx(1, "%u errors", errors);
+	}
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * mmaptest: exercise mmap, munmap, and fsync.
+ *
+ * Checks that anonymous mappings read as zero, that changes to a
+ * shared file mapping reach the file (on fsync and on munmap), that a
+ * page written back isn't written again until it changes, and that
+ * changes to a private one don't, that munmap can punch a hole in a
+ * mapping, and that a shared anonymous mapping is shared with a child
+ * after fork. Then times summing a file with read() against summing
+ * it through a mapping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../lib/testutils.h"
+
+#define PAGE    (4096)
+#define NPAGES  (16)
+#define FILESZ  (NPAGES * PAGE + 100)   /* last page only partly in the file */
+#define FNAME   "mmaptest.dat"
+#define NSCANS  (8)
+
+static char buf[PAGE];
+
+static
+int
+fill_file(void)
+{
+   int fd, i;
+
+   fd = open(FNAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+   TEST_POSITIVE(fd, "could not create " FNAME);
+   for (i=0; i<PAGE; i++) {
+     buf[i] = i % 251;
+   }
+   for (i=0; i<NPAGES; i++) {
+     TEST_EQUAL(write(fd, buf, PAGE), PAGE, "write failed");
+   }
+   TEST_EQUAL(write(fd, buf, 100), 100, "write failed");
+   return fd;
+}
+
+/* what's at OFFSET in the file, by read() */
+static
+int
+file_byte(int fd, off_t offset)
+{
+   char c;
+
+   lseek(fd, offset, SEEK_SET);
+   if (read(fd, &c, 1) != 1) {
+     return -1;
+   }
+   return (unsigned char)c;
+}
+
+static
+unsigned long
+elapsed_ms(time_t secs0, unsigned long nsecs0)
+{
+   time_t secs1;
+   unsigned long nsecs1, ms;
+
+   __time(&secs1, &nsecs1);
+   ms = (secs1 - secs0) * 1000;
+   ms = ms + nsecs1 / 1000000 - nsecs0 / 1000000;
+   return ms == 0 ? 1 : ms;
+}
+
+static
+void
+bench(int fd)
+{
+   time_t secs0;
+   unsigned long nsecs0, ms_read, ms_map, sum_read, sum_map;
+   unsigned char *p;
+   int i, j, n;
+
+   sum_read = 0;
+   __time(&secs0, &nsecs0);
+   for (i=0; i<NSCANS; i++) {
+     lseek(fd, 0, SEEK_SET);
+     while ((n = read(fd, buf, PAGE)) > 0) {
+       for (j=0; j<n; j++) {
+         sum_read += (unsigned char)buf[j];
+       }
+     }
+   }
+   ms_read = elapsed_ms(secs0, nsecs0);
+
+   sum_map = 0;
+   __time(&secs0, &nsecs0);
+   for (i=0; i<NSCANS; i++) {
+     p = mmap(NULL, FILESZ, PROT_READ, MAP_PRIVATE, fd, 0);
+     TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "mmap for scan failed");
+     for (j=0; j<FILESZ; j++) {
+       sum_map += p[j];
+     }
+     munmap(p, FILESZ);
+   }
+   ms_map = elapsed_ms(secs0, nsecs0);
+
+   TEST_EQUAL((int)sum_map, (int)sum_read, "mapped scan saw different data");
+   printf("scan %d x %d bytes: read() %lu ms, mmap %lu ms\n",
+          NSCANS, FILESZ, ms_read, ms_map);
+}
+
+int
+main()
+{
+   unsigned char *p, *q;
+   int fd, i, bad, status;
+   pid_t pid;
+
+   /* anonymous memory */
+   p = mmap(NULL, NPAGES * PAGE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANON, -1, 0);
+   TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "anonymous mmap failed");
+   TEST_EQUAL((int)p % PAGE, 0, "mapping not page-aligned");
+   bad = 0;
+   for (i=0; i<NPAGES * PAGE; i++) {
+     if (p[i] != 0) {
+       bad = 1;
+       break;
+     }
+   }
+   TEST_EQUAL(bad, 0, "anonymous memory not zeroed");
+   for (i=0; i<NPAGES; i++) {
+     p[i * PAGE] = i + 1;
+   }
+
+   /* punch a hole in the middle; the rest stays */
+   TEST_EQUAL(munmap(p + 4 * PAGE, 2 * PAGE), 0, "munmap of a hole failed");
+   TEST_EQUAL(p[3 * PAGE], 4, "munmap lost the bottom part");
+   TEST_EQUAL(p[6 * PAGE], 7, "munmap lost the top part");
+   TEST_EQUAL(munmap(p, NPAGES * PAGE), 0, "munmap failed");
+
+   /* bad arguments */
+   q = mmap(NULL, 0, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+   TEST_EQUAL((int)q, (int)MAP_FAILED, "zero-length mmap worked");
+   TEST_EQUAL(errno, EINVAL, "zero-length mmap: wrong error");
+   q = mmap(NULL, PAGE, PROT_READ, MAP_PRIVATE, 99, 0);
+   TEST_EQUAL((int)q, (int)MAP_FAILED, "mmap of a bad fd worked");
+   TEST_EQUAL(errno, EBADF, "mmap of a bad fd: wrong error");
+
+   /* shared file mapping: changes reach the file */
+   fd = fill_file();
+   p = mmap(NULL, FILESZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "shared file mmap failed");
+   TEST_EQUAL(p[PAGE + 7], 7, "mapped data wrong");
+   TEST_EQUAL(p[FILESZ], 0, "page past end of file not zeroed");
+   p[5] = 200;
+   p[FILESZ - 1] = 201;
+   TEST_EQUAL(fsync(fd), 0, "fsync failed");
+   TEST_EQUAL(file_byte(fd, 5), 200, "fsync did not write back");
+   TEST_EQUAL(file_byte(fd, FILESZ - 1), 201, "last page not written back");
+
+   /* written-back pages are clean until they're written again */
+   lseek(fd, 6, SEEK_SET);
+   buf[0] = 99;
+   TEST_EQUAL(write(fd, buf, 1), 1, "write failed");
+   p[3 * PAGE] = 204;
+   TEST_EQUAL(fsync(fd), 0, "fsync failed");
+   TEST_EQUAL(file_byte(fd, 6), 99, "clean page written back again");
+   TEST_EQUAL(file_byte(fd, 3 * PAGE), 204, "second fsync did not write back");
+   p[5] = 205;
+   TEST_EQUAL(fsync(fd), 0, "fsync failed");
+   TEST_EQUAL(file_byte(fd, 5), 205, "write to a cleaned page lost");
+
+   p[2 * PAGE] = 202;
+   TEST_EQUAL(munmap(p, FILESZ), 0, "munmap failed");
+   TEST_EQUAL(file_byte(fd, 2 * PAGE), 202, "munmap did not write back");
+   TEST_EQUAL(file_byte(fd, FILESZ), -1, "write-back extended the file");
+
+   /* private file mapping: changes stay private */
+   p = mmap(NULL, FILESZ, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, PAGE);
+   TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "private file mmap failed");
+   TEST_EQUAL(p[PAGE], 202, "offset mapping sees wrong data");
+   p[0] = 203;
+   TEST_EQUAL(munmap(p, FILESZ), 0, "munmap failed");
+   TEST_EQUAL(file_byte(fd, PAGE), 0, "private change reached the file");
+
+   /* shared anonymous memory is shared with a child */
+   p = mmap(NULL, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+   TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "shared anonymous mmap failed");
+   p[0] = 1;
+   pid = fork();
+   if (pid == 0) {
+     p[0] = 2;
+     _exit(0);
+   }
+   TEST_POSITIVE(pid, "fork failed");
+   waitpid(pid, &status, 0);
+   TEST_EQUAL(p[0], 2, "child's change not seen by parent");
+   munmap(p, PAGE);
+
+   bench(fd);
+
+   close(fd);
+   remove(FNAME);
+
+   TEST_STATS();
+
+   exit(0);
+}
@@ -0,0 +1,105 @@
+/*
+ * rusage: sanity checks for getrusage.
+ *
+ * Burns some cpu in user mode and checks that it shows up as user
+ * time; writes to the console and checks the byte count; then forks
+ * a child that does the same and checks that, once it has been
+ * waited for, its usage is charged to RUSAGE_CHILDREN. Prints the
+ * numbers so they can be eyeballed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../lib/testutils.h"
+
+#define SPIN  (4000000)
+
+static volatile unsigned sink;
+
+static
+void
+spin(void)
+{
+   unsigned i;
+
+   for (i=0; i<SPIN; i++) {
+     sink += i;
+   }
+}
+
+static
+void
+show(const char *who, const struct rusage *ru)
+{
+   printf("%s: user %d.%06d sys %d.%06d minflt %d majflt %d "
+          "nvcsw %d nivcsw %d in %d/%d out %d/%d\n", who,
+          (int)ru->ru_utime.tv_sec, (int)ru->ru_utime.tv_usec,
+          (int)ru->ru_stime.tv_sec, (int)ru->ru_stime.tv_usec,
+          (int)ru->ru_minflt, (int)ru->ru_majflt,
+          (int)ru->ru_nvcsw, (int)ru->ru_nivcsw,
+          (int)ru->ru_inblock, (int)ru->ru_inbytes,
+          (int)ru->ru_oublock, (int)ru->ru_outbytes);
+}
+
+int
+main()
+{
+   struct rusage before, after, kids;
+   static const char msg[] = "rusage: 32 bytes to the console\n";
+   pid_t pid;
+   int rc, status;
+
+   rc = getrusage(RUSAGE_SELF, &before);
+   TEST_EQUAL(rc, 0, "getrusage(RUSAGE_SELF) failed");
+
+   spin();
+   rc = write(STDOUT_FILENO, msg, strlen(msg));
+   TEST_EQUAL(rc, (int)strlen(msg), "write failed");
+
+   rc = getrusage(RUSAGE_SELF, &after);
+   TEST_EQUAL(rc, 0, "getrusage(RUSAGE_SELF) failed");
+   TEST_POSITIVE(after.ru_utime.tv_sec * 1000000 + after.ru_utime.tv_usec -
+                 before.ru_utime.tv_sec * 1000000 - before.ru_utime.tv_usec,
+                 "spinning did not use any user time");
+   TEST_EQUAL((int)(after.ru_outbytes - before.ru_outbytes),
+              (int)strlen(msg), "wrong output byte count");
+   TEST_POSITIVE((int)(after.ru_oublock - before.ru_oublock),
+                 "write not counted");
+   show("self", &after);
+
+   /* nothing waited for yet */
+   rc = getrusage(RUSAGE_CHILDREN, &kids);
+   TEST_EQUAL(rc, 0, "getrusage(RUSAGE_CHILDREN) failed");
+   TEST_EQUAL((int)kids.ru_outbytes, 0, "children charged too early");
+
+   pid = fork();
+   TEST_NOT_EQUAL(pid, -1, "fork failed");
+   if (pid == 0) {
+     spin();
+     write(STDOUT_FILENO, msg, strlen(msg));
+     _exit(0);
+   }
+   rc = waitpid(pid, &status, 0);
+   TEST_EQUAL(rc, pid, "waitpid failed");
+
+   rc = getrusage(RUSAGE_CHILDREN, &kids);
+   TEST_EQUAL(rc, 0, "getrusage(RUSAGE_CHILDREN) failed");
+   TEST_POSITIVE(kids.ru_utime.tv_sec * 1000000 + kids.ru_utime.tv_usec,
+                 "child's user time not charged");
+   TEST_EQUAL((int)kids.ru_outbytes, (int)strlen(msg),
+              "child's output not charged");
+   show("children", &kids);
+
+   rc = getrusage(1234, &kids);
+   TEST_EQUAL(rc, -1, "getrusage with a bad who should fail");
+   TEST_EQUAL(errno, EINVAL, "getrusage with a bad who: wrong error");
+
+   TEST_STATS();
+
+   exit(0);
+}
@@ -0,0 +1,93 @@
+/*
+ * sbrktest: exercise sbrk.
+ *
+ * Checks that the heap starts page-aligned and empty, that new heap
+ * memory reads as zero and keeps what's written to it, that shrinking
+ * and regrowing gives back zeroed pages, that fork copies the heap,
+ * and that the break can't go below the heap base or grow without
+ * bound.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "../lib/testutils.h"
+
+#define PAGE    (4096)
+#define NPAGES  (64)
+
+int
+main()
+{
+   char *base, *p;
+   int i, bad, status;
+   pid_t pid;
+
+   base = sbrk(0);
+   TEST_NOT_EQUAL((int)base, -1, "sbrk(0) failed");
+   TEST_EQUAL((int)base % PAGE, 0, "heap base not page-aligned");
+
+   p = sbrk(NPAGES * PAGE);
+   TEST_EQUAL((int)p, (int)base, "sbrk did not return the old break");
+   TEST_EQUAL((int)sbrk(0), (int)(base + NPAGES * PAGE), "break not moved");
+
+   bad = 0;
+   for (i=0; i<NPAGES * PAGE; i++) {
+     if (base[i] != 0) {
+       bad = 1;
+       break;
+     }
+   }
+   TEST_EQUAL(bad, 0, "new heap memory not zeroed");
+
+   for (i=0; i<NPAGES; i++) {
+     base[i * PAGE] = i + 1;
+   }
+
+   /* the child gets a copy */
+   pid = fork();
+   if (pid == 0) {
+     for (i=0; i<NPAGES; i++) {
+       if (base[i * PAGE] != i + 1) {
+         _exit(1);
+       }
+       base[i * PAGE] = 0;
+     }
+     _exit(0);
+   }
+   TEST_POSITIVE(pid, "fork failed");
+   waitpid(pid, &status, 0);
+   TEST_EQUAL(WEXITSTATUS(status), 0, "child's heap differs");
+
+   bad = 0;
+   for (i=0; i<NPAGES; i++) {
+     if (base[i * PAGE] != i + 1) {
+       bad = 1;
+     }
+   }
+   TEST_EQUAL(bad, 0, "child changed the parent's heap");
+
+   /* shrink by half, grow back: the top half is fresh */
+   p = sbrk(-(NPAGES / 2) * PAGE);
+   TEST_EQUAL((int)p, (int)(base + NPAGES * PAGE), "shrink failed");
+   sbrk((NPAGES / 2) * PAGE);
+   TEST_EQUAL(base[0], 1, "shrink lost the bottom half");
+   TEST_EQUAL(base[(NPAGES / 2) * PAGE], 0, "regrown page not zeroed");
+
+   /* limits */
+   p = sbrk(-(NPAGES + 1) * PAGE);
+   TEST_EQUAL((int)p, -1, "shrinking below the heap base worked");
+   TEST_EQUAL(errno, EINVAL, "shrinking below the heap base: wrong error");
+   p = sbrk(0x40000000);
+   TEST_EQUAL((int)p, -1, "growing by 1G worked");
+   TEST_EQUAL(errno, ENOMEM, "growing by 1G: wrong error");
+
+   sbrk(-NPAGES * PAGE);
+   TEST_EQUAL((int)sbrk(0), (int)base, "heap not back to empty");
+
+   TEST_STATS();
+
+   exit(0);
+}
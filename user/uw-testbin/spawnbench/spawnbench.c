@@ -0,0 +1,82 @@
+/*
+ * spawnbench: how many commands a second can we start?
+ *
+ * Runs /bin/true N times (default 50) each of three ways and reports
+ * the rate: fork+execv, vfork+execv, and vfork+execv of
+ * "/bin/sh -c /bin/true", which is what a command costs when it goes
+ * through the shell.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_N 50
+
+static char *true_args[] = { (char *)"/bin/true", NULL };
+static char *sh_args[] = { (char *)"/bin/sh", (char *)"-c",
+			   (char *)"/bin/true", NULL };
+
+static
+void
+run(int usevfork, char **args)
+{
+	pid_t pid;
+	int status;
+
+	pid = usevfork ? vfork() : fork();
+	if (pid < 0) {
+		err(1, usevfork ? "vfork" : "fork");
+	}
+	if (pid == 0) {
+		execv(args[0], args);
+		_exit(1);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "%s: exit status %d", args[0], status);
+	}
+}
+
+static
+void
+bench(const char *name, int usevfork, char **args, int n)
+{
+	time_t secs0, secs1;
+	unsigned long nsecs0, nsecs1;
+	unsigned long ms;
+	int i;
+
+	__time(&secs0, &nsecs0);
+	for (i=0; i<n; i++) {
+		run(usevfork, args);
+	}
+	__time(&secs1, &nsecs1);
+
+	ms = (secs1 - secs0) * 1000;
+	ms = ms + nsecs1 / 1000000 - nsecs0 / 1000000;
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("%-14s %4d commands in %lu.%03lu s: %lu commands/s\n",
+	       name, n, ms / 1000, ms % 1000, n * 1000UL / ms);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int n = DEFAULT_N;
+
+	if (argc > 1) {
+		n = atoi(argv[1]);
+	}
+
+	bench("fork+exec", 0, true_args, n);
+	bench("vfork+exec", 1, true_args, n);
+	bench("vfork+sh -c", 1, sh_args, n);
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * stacktest: exercise a stack bigger than the old 48K.
+ *
+ * Puts a 1M array on the stack and checks that it starts out zeroed,
+ * keeps what's written to it, and is copied by fork. Then recurses a
+ * few thousand frames deep, and touches a few pages of another 4M
+ * array, most of which is never used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../lib/testutils.h"
+
+#define PAGE     (4096)
+#define BIGPAGES (256)		/* 1M */
+#define HUGE     (4 * 1024 * 1024)
+#define DEPTH    (4000)
+
+static
+int
+bigarray(void)
+{
+   char big[BIGPAGES * PAGE];
+   int i, bad, status;
+   pid_t pid;
+
+   bad = 0;
+   for (i=0; i<BIGPAGES; i++) {
+     if (big[i * PAGE] != 0 || big[i * PAGE + PAGE - 1] != 0) {
+       bad = 1;
+     }
+     big[i * PAGE] = i + 1;
+   }
+   TEST_EQUAL(bad, 0, "new stack memory not zeroed");
+
+   pid = fork();
+   if (pid == 0) {
+     for (i=0; i<BIGPAGES; i++) {
+       if (big[i * PAGE] != (char)(i + 1)) {
+         _exit(1);
+       }
+       big[i * PAGE] = 0;
+     }
+     _exit(0);
+   }
+   TEST_POSITIVE(pid, "fork failed");
+   waitpid(pid, &status, 0);
+   TEST_EQUAL(WEXITSTATUS(status), 0, "child's stack differs");
+
+   bad = 0;
+   for (i=0; i<BIGPAGES; i++) {
+     if (big[i * PAGE] != (char)(i + 1)) {
+       bad = 1;
+     }
+   }
+   return bad;
+}
+
+static
+int
+recurse(int n)
+{
+   volatile int frame[32];
+
+   frame[0] = n;
+   if (n == 0) {
+     return 0;
+   }
+   return recurse(n - 1) + frame[0] - n + 1;
+}
+
+static
+int
+sparse(void)
+{
+   char huge[HUGE];
+   int i;
+
+   for (i=0; i<HUGE; i += HUGE / 8) {
+     huge[i] = 1;
+   }
+   return huge[0] + huge[HUGE / 2] + huge[HUGE - HUGE / 8];
+}
+
+int
+main()
+{
+   TEST_EQUAL(bigarray(), 0, "fork changed the parent's stack");
+   TEST_EQUAL(recurse(DEPTH), DEPTH, "deep recursion went wrong");
+   TEST_EQUAL(sparse(), 3, "sparse stack array went wrong");
+
+   TEST_STATS();
+
+   exit(0);
+}
@@ -0,0 +1,156 @@
+/*
+ * stdiotest: check that stdio buffers, and count what it saves.
+ *
+ * Uses getrusage's count of write calls to see how many system calls
+ * each kind of output costs: print-heavy loops like hash's to a
+ * line-buffered, fully-buffered, and unbuffered stdout, and a file
+ * written and read back through fopen. Before stdio was buffered,
+ * every character printed cost a write. Also checks that writes which
+ * cross a buffer boundary reach the file whole.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "../lib/testutils.h"
+
+#define NLINES   (10)
+#define NRECS    (1000)
+#define TESTFILE "stdiotest.tmp"
+#define NBIG     (BUFSIZ + BUFSIZ / 2)
+
+static
+int
+writes(void)
+{
+   struct rusage ru;
+
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_oublock;
+}
+
+static
+int
+reads(void)
+{
+   struct rusage ru;
+
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_inblock;
+}
+
+static
+int
+lines(void)
+{
+   int i, bytes = 0;
+
+   for (i=0; i<NLINES; i++) {
+     bytes += printf("Hash : %d (line %d of %d)\n", i * 7919, i + 1, NLINES);
+   }
+   return bytes;
+}
+
+int
+main()
+{
+   char buf[64], expect[64];
+   static char big[NBIG], back[NBIG + 1];
+   FILE *f;
+   int before, n, bytes, i;
+
+   /* line-buffered: one write per line */
+   before = writes();
+   bytes = lines();
+   n = writes() - before;
+   TEST_EQUAL(n, NLINES, "line-buffered stdout: wrong number of writes");
+   printf("line-buffered: %d writes for %d bytes\n", n, bytes);
+
+   /* fully buffered: one write for the lot */
+   setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+   before = writes();
+   bytes = lines();
+   fflush(stdout);
+   n = writes() - before;
+   TEST_EQUAL(n, 1, "fully-buffered stdout: wrong number of writes");
+   printf("fully-buffered: %d writes for %d bytes\n", n, bytes);
+   fflush(stdout);
+
+   /* unbuffered: one write per chunk printf hands over */
+   setvbuf(stdout, NULL, _IONBF, 0);
+   before = writes();
+   for (i=0; i<NLINES; i++) {
+     putchar('.');
+   }
+   putchar('\n');
+   n = writes() - before;
+   TEST_EQUAL(n, NLINES + 1, "unbuffered stdout: wrong number of writes");
+   setvbuf(stdout, NULL, _IOLBF, 0);
+
+   /* a file, written and read back */
+   f = fopen(TESTFILE, "w");
+   TEST_EQUAL(f != NULL, 1, "fopen for writing failed");
+   if (f == NULL) {
+     exit(1);
+   }
+   before = writes();
+   bytes = 0;
+   for (i=0; i<NRECS; i++) {
+     bytes += fprintf(f, "record %d\n", i);
+   }
+   TEST_EQUAL(fclose(f), 0, "fclose failed");
+   n = writes() - before;
+   TEST_EQUAL(n, (bytes + BUFSIZ - 1) / BUFSIZ, "file: wrong number of writes");
+   printf("file: %d writes for %d bytes\n", n, bytes);
+
+   f = fopen(TESTFILE, "r");
+   TEST_EQUAL(f != NULL, 1, "fopen for reading failed");
+   if (f == NULL) {
+     exit(1);
+   }
+   before = reads();
+   for (i=0; fgets(buf, sizeof(buf), f) != NULL; i++) {
+     snprintf(expect, sizeof(expect), "record %d\n", i);
+     if (strcmp(buf, expect)) {
+       TEST_EQUAL(0, 1, "file: read back the wrong data");
+       break;
+     }
+   }
+   TEST_EQUAL(i, NRECS, "file: wrong number of records read back");
+   TEST_EQUAL(feof(f), 1, "file: no end of file");
+   n = reads() - before;
+   printf("file: %d reads for %d bytes\n", n, bytes);
+   fclose(f);
+   remove(TESTFILE);
+
+   /* writes that fill the buffer part way through keep their tails */
+   for (i=0; i<NBIG; i++) {
+     big[i] = 'a' + i % 26;
+   }
+   f = fopen(TESTFILE, "w");
+   TEST_EQUAL(f != NULL, 1, "fopen for writing failed");
+   if (f == NULL) {
+     exit(1);
+   }
+   fwrite(big, 1, 100, f);
+   fwrite(big + 100, 1, NBIG - 100, f);
+   TEST_EQUAL(fclose(f), 0, "fclose failed");
+   f = fopen(TESTFILE, "r");
+   TEST_EQUAL(f != NULL, 1, "fopen for reading failed");
+   if (f == NULL) {
+     exit(1);
+   }
+   n = fread(back, 1, sizeof(back), f);
+   TEST_EQUAL(n, NBIG, "boundary: wrong file size");
+   TEST_EQUAL(memcmp(big, back, NBIG), 0, "boundary: wrong file contents");
+   fclose(f);
+   remove(TESTFILE);
+
+   TEST_STATS();
+
+   /* exit flushes; _exit would lose this line */
+   printf("stdiotest done\n");
+   exit(0);
+}
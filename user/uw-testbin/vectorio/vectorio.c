@@ -0,0 +1,90 @@
+/*
+ * vectorio: exercise writev/readv and pread/pwrite/preadv/pwritev.
+ *
+ * Writes a file as three scattered pieces with one writev, reads it
+ * back into a different split with readv, then overwrites and reads
+ * the middle with the positional calls and checks that they leave the
+ * seek position alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../lib/testutils.h"
+
+#define FILENAME "VECTORIO_FILE"
+#define A_INTS   (100)
+#define B_INTS   (1000)
+#define C_INTS   (10)
+#define ALL_INTS (A_INTS + B_INTS + C_INTS)
+
+static int a[A_INTS], b[B_INTS], c[C_INTS];
+static int in[ALL_INTS];
+
+int
+main()
+{
+   struct iovec iov[3];
+   int i, rc, fd, v;
+   int mid[2];
+
+   for (i=0; i<A_INTS; i++) a[i] = i;
+   for (i=0; i<B_INTS; i++) b[i] = A_INTS + i;
+   for (i=0; i<C_INTS; i++) c[i] = A_INTS + B_INTS + i;
+
+   fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC);
+   TEST_POSITIVE(fd, "Open file named " FILENAME " failed\n");
+
+   /* one writev for all three pieces */
+   iov[0].iov_base = a; iov[0].iov_len = sizeof(a);
+   iov[1].iov_base = b; iov[1].iov_len = sizeof(b);
+   iov[2].iov_base = c; iov[2].iov_len = sizeof(c);
+   rc = writev(fd, iov, 3);
+   TEST_EQUAL(rc, sizeof(a) + sizeof(b) + sizeof(c), "writev short");
+
+   /* read it back split differently */
+   rc = lseek(fd, 0, SEEK_SET);
+   TEST_EQUAL(rc, 0, "lseek to start failed");
+   iov[0].iov_base = in; iov[0].iov_len = 7 * sizeof(int);
+   iov[1].iov_base = in + 7; iov[1].iov_len = (ALL_INTS - 7) * sizeof(int);
+   rc = readv(fd, iov, 2);
+   TEST_EQUAL(rc, sizeof(in), "readv short");
+   for (i=0; i<ALL_INTS; i++) {
+     TEST_EQUAL(in[i], i, "readv value not equal to value written");
+   }
+
+   /* positional writes and reads don't move the seek position */
+   v = -1;
+   rc = pwrite(fd, &v, sizeof(v), 50 * sizeof(int));
+   TEST_EQUAL(rc, sizeof(v), "pwrite failed");
+   mid[0] = mid[1] = 0;
+   iov[0].iov_base = &mid[0]; iov[0].iov_len = sizeof(int);
+   iov[1].iov_base = &mid[1]; iov[1].iov_len = sizeof(int);
+   rc = preadv(fd, iov, 2, 49 * sizeof(int));
+   TEST_EQUAL(rc, 2 * sizeof(int), "preadv failed");
+   TEST_EQUAL(mid[0], 49, "preadv read wrong value");
+   TEST_EQUAL(mid[1], -1, "preadv did not see pwrite");
+
+   v = -2;
+   iov[0].iov_base = &v; iov[0].iov_len = sizeof(v);
+   rc = pwritev(fd, iov, 1, 51 * sizeof(int));
+   TEST_EQUAL(rc, sizeof(v), "pwritev failed");
+   rc = pread(fd, &v, sizeof(v), 51 * sizeof(int));
+   TEST_EQUAL(rc, sizeof(v), "pread failed");
+   TEST_EQUAL(v, -2, "pread did not see pwritev");
+
+   rc = lseek(fd, 0, SEEK_CUR);
+   TEST_EQUAL(rc, sizeof(in), "positional I/O moved the seek position");
+
+   /* not seekable */
+   rc = pread(STDIN_FILENO, &v, sizeof(v), 0);
+   TEST_NEGATIVE(rc, "pread on the console should fail");
+
+   close(fd);
+
+   TEST_STATS();
+
+   exit(0);
+}
@@ -0,0 +1,95 @@
+/*
+ * waitany: exercise waitpid(-1) and WNOHANG, and orphan reaping.
+ *
+ * Forks NKIDS children that exit with different codes and collects
+ * them all with waitpid(-1), checking that each pid and status comes
+ * back exactly once. Then checks WNOHANG against a child that is
+ * still running, and that with no children left waitpid(-1) fails.
+ * Finally forks, many times over, a child that forks a grandchild and
+ * exits without waiting for it; the kernel has to reap those orphans
+ * or the process table fills up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "../lib/testutils.h"
+
+#define NKIDS    (8)
+#define NORPHANS (200)
+
+int
+main()
+{
+   pid_t pids[NKIDS];
+   int seen[NKIDS];
+   pid_t pid;
+   int i, j, status, rc;
+
+   for (i=0; i<NKIDS; i++) {
+     pids[i] = fork();
+     TEST_NOT_EQUAL(pids[i], -1, "fork failed");
+     if (pids[i] == 0) {
+       _exit(i + 1);
+     }
+     seen[i] = 0;
+   }
+
+   for (i=0; i<NKIDS; i++) {
+     pid = waitpid(-1, &status, 0);
+     TEST_POSITIVE(pid, "waitpid(-1) failed");
+     for (j=0; j<NKIDS; j++) {
+       if (pids[j] == pid) {
+         break;
+       }
+     }
+     TEST_NOT_EQUAL(j, NKIDS, "waitpid(-1) returned a pid that isn't ours");
+     if (j < NKIDS) {
+       TEST_EQUAL(seen[j], 0, "waitpid(-1) returned the same child twice");
+       seen[j] = 1;
+       TEST_EQUAL(WIFEXITED(status), 1, "child did not exit normally");
+       TEST_EQUAL(WEXITSTATUS(status), j + 1, "wrong exit status");
+     }
+   }
+
+   /* nothing left to wait for */
+   rc = waitpid(-1, &status, 0);
+   TEST_EQUAL(rc, -1, "waitpid(-1) with no children should fail");
+   TEST_EQUAL(errno, ECHILD, "waitpid(-1) with no children: wrong error");
+
+   /* WNOHANG on a child that hasn't exited */
+   pid = fork();
+   if (pid == 0) {
+     /* stay around for a bit */
+     for (i=0; i<5000; i++) {
+       getpid();
+     }
+     _exit(0);
+   }
+   rc = waitpid(pid, &status, WNOHANG);
+   TEST_EQUAL_ONE_OF(rc, 0, pid, "waitpid WNOHANG: wrong return");
+   if (rc == 0) {
+     rc = waitpid(pid, &status, 0);
+     TEST_EQUAL(rc, pid, "waitpid after WNOHANG failed");
+   }
+
+   /* orphans */
+   for (i=0; i<NORPHANS; i++) {
+     pid = fork();
+     if (pid == 0) {
+       if (fork() == 0) {
+         _exit(0);
+       }
+       _exit(0);
+     }
+     TEST_POSITIVE(pid, "fork failed making an orphan");
+     rc = waitpid(pid, &status, 0);
+     TEST_EQUAL(rc, pid, "waitpid on orphan's parent failed");
+   }
+
+   TEST_STATS();
+
+   exit(0);
+}
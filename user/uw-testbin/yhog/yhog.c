@@ -39,6 +39,9 @@ main(void)
 {
 	volatile int i;
 
+	/* the point is to see our output interleave with the others' */
+	setvbuf(stdout, NULL, _IONBF, 0);
+
 	for (i=0; i<50000; i++) {
 	  if (i%10000 == 0) {
 	    putchar('y');